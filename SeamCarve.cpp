@@ -1,219 +1,3730 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/utils/allocator_stats.impl.hpp>
+#include "SeamCarveKernels.simd.hpp"
+#include "SeamCarveKernels.simd_declarations.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace cv;
 
+// Carving kernels of one instruction set, built from SeamCarveKernels.simd.hpp
+struct CarveKernels {
+    const char* name;
+    void (*energyRow)(const uchar* above, const uchar* row, const uchar* below, uchar* energy, int cols);
+    void (*cumulativeRow)(const int* above, const uchar* energy, int* row, int n);
+    void (*cumulativeRowMasked)(const int* above, const uchar* energy, const uchar* mask, int protected_energy, int* row, int n);
+    int (*compactRow)(const uchar* src, const uchar* mark, uchar* dst, int cols, size_t pixel_size);
+};
+
+#define SEAMCARVE_KERNELS(name, tier) { name, seamcarve::tier::energyRow, seamcarve::tier::cumulativeRow, \
+    seamcarve::tier::cumulativeRowMasked, seamcarve::tier::compactRow }
+
+// Function to get the carving kernels for this CPU, picked on first use
+// The best tier the CPU supports is used unless the SEAMCARVE_CPU environment variable caps it at a lower one
+// (baseline, sse4_2, avx2 or avx512), which lets the lower tiers be benchmarked on newer machines.
+// Features disabled with OPENCV_CPU_DISABLE count as unsupported.
+const CarveKernels& carveKernels() {
+    static const CarveKernels kernels = []() {
+        vector<pair<CarveKernels, bool>> tiers = { { SEAMCARVE_KERNELS("baseline", cpu_baseline), true } };
+#ifdef SEAMCARVE_DISPATCH_X86
+        tiers.push_back({ SEAMCARVE_KERNELS("sse4_2", opt_SSE4_2), checkHardwareSupport(CV_CPU_SSE4_2) });
+        tiers.push_back({ SEAMCARVE_KERNELS("avx2", opt_AVX2), checkHardwareSupport(CV_CPU_AVX2)
+            && checkHardwareSupport(CV_CPU_FMA3) && checkHardwareSupport(CV_CPU_FP16) });
+        tiers.push_back({ SEAMCARVE_KERNELS("avx512", opt_AVX512_SKX), checkHardwareSupport(CV_CPU_AVX512_SKX) });
+#endif
+
+        size_t limit = tiers.size() - 1;
+        const char* requested = getenv("SEAMCARVE_CPU");
+        if (requested && *requested) {
+            auto tier = find_if(tiers.begin(), tiers.end(),
+                [requested](const pair<CarveKernels, bool>& t) { return string(t.first.name) == requested; });
+            if (tier == tiers.end())
+                cout << "Unknown SEAMCARVE_CPU value '" << requested << "', ignored" << endl;
+            else
+                limit = tier - tiers.begin();
+        }
+
+        size_t chosen = 0;
+        for (size_t t = 1; t <= limit; t++) {
+            if (tiers[t].second)
+                chosen = t;
+        }
+        return tiers[chosen].first;
+    }();
+    return kernels;
+}
+
+// Function to convert an image to the single channel image its energy is computed from
+Mat convertToGray(const Mat& image) {
+    Mat gray;
+    if (image.channels() == 1)
+        gray = image;
+    else if (image.channels() == 3)
+        cvtColor(image, gray, COLOR_BGR2GRAY);
+    else if (image.channels() == 4)
+        cvtColor(image, gray, COLOR_BGRA2GRAY);
+    else
+        extractChannel(image, gray, 0);
+    return gray;
+}
+
 // Function to compute the energy map of the image
+// Accepts 1, 3 or 4 channel images of 8-bit, 16-bit or floating point depth
+// and always returns an 8-bit energy map so the seam search is type independent
 Mat computeEnergyMap(const Mat& image) {
-    Mat gray, grad_x, grad_y, abs_grad_x, abs_grad_y, energy_map;
+    Mat grad_x, grad_y, abs_grad_x, abs_grad_y, energy_map;
+
+    // Convert the input image to grayscale
+    Mat gray = convertToGray(image);
+
+    if (gray.depth() == CV_8U) {
+        // Sobel gradients along X and Y, their saturated absolute values and their mean in one pass per row
+        // The rows above and below are reflected at the image border like the Sobel filter does
+        const CarveKernels& kernels = carveKernels();
+        energy_map.create(gray.size(), CV_8U);
+        for (int i = 0; i < gray.rows; i++) {
+            const uchar* above = gray.ptr<uchar>(i > 0 ? i - 1 : min(1, gray.rows - 1));
+            const uchar* below = gray.ptr<uchar>(i < gray.rows - 1 ? i + 1 : max(gray.rows - 2, 0));
+            kernels.energyRow(above, gray.ptr<uchar>(i), below, energy_map.ptr<uchar>(i), gray.cols);
+        }
+        return energy_map;
+    }
+    else {
+        // Wider depths are differentiated in floating point and scaled to the 8-bit range
+        // 16-bit images span 0..65535, floating point images are expected in 0..1
+        double scale = gray.depth() == CV_16U ? 1.0 / 257.0 : gray.depth() == CV_16S ? 1.0 / 128.0 : 255.0;
+        Sobel(gray, grad_x, CV_32F, 1, 0, 3);
+        Sobel(gray, grad_y, CV_32F, 0, 1, 3);
+        convertScaleAbs(grad_x, abs_grad_x, scale);
+        convertScaleAbs(grad_y, abs_grad_y, scale);
+    }
+
+    // Combine the absolute gradients to form the energy map
+    // Each pixel's energy is the sum of its absolute gradients in X and Y
+    addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, energy_map);
+
+    return energy_map;
+}
+
+// Maps a channel type and count to the pixel type used by the carving engine
+template <typename T, int cn>
+struct SeamPixel {
+    typedef Vec<T, cn> type;
+};
+
+// Single channel images are carved as plain scalars
+template <typename T>
+struct SeamPixel<T, 1> {
+    typedef T type;
+};
+
+// Function to copy every row of the image except the seam pixel into the output
+template <typename T, int cn>
+void removeSeamPixels(const Mat& image, const vector<int>& seam, Mat& output) {
+    typedef typename SeamPixel<T, cn>::type Pixel;
+    int cols = image.cols;
+
+    for (int i = 0; i < image.rows; i++) {
+        const Pixel* src = image.ptr<Pixel>(i);
+        Pixel* dst = output.ptr<Pixel>(i);
+        int idx = seam[i];
+
+        // Copy pixels before the seam
+        std::copy(src, src + idx, dst);
+
+        // Shift pixels after the seam to the left by one
+        std::copy(src + idx + 1, src + cols, dst + idx);
+    }
+}
+
+// Fallback for pixel types without a specialization, copying raw bytes per pixel
+void removeSeamBytes(const Mat& image, const vector<int>& seam, Mat& output) {
+    size_t pixel_size = image.elemSize();
+    int cols = image.cols;
+
+    for (int i = 0; i < image.rows; i++) {
+        const uchar* src = image.ptr<uchar>(i);
+        uchar* dst = output.ptr<uchar>(i);
+        size_t idx = seam[i];
+
+        memcpy(dst, src, idx * pixel_size);
+        memcpy(dst + idx * pixel_size, src + (idx + 1) * pixel_size, (cols - idx - 1) * pixel_size);
+    }
+}
+
+// Function to remove a vertical seam from an image of any pixel type
+// The seam holds one column index per row
+void removeVerticalSeam(Mat& image, const vector<int>& seam) {
+    // Create an output image with one less column to remove the seam
+    Mat output(image.rows, image.cols - 1, image.type());
+
+    // Dispatch to the specialization for the common pixel types
+    switch (image.type()) {
+    case CV_8UC1:  removeSeamPixels<uchar, 1>(image, seam, output); break;
+    case CV_8UC3:  removeSeamPixels<uchar, 3>(image, seam, output); break;
+    case CV_8UC4:  removeSeamPixels<uchar, 4>(image, seam, output); break;
+    case CV_16UC1: removeSeamPixels<ushort, 1>(image, seam, output); break;
+    case CV_16UC3: removeSeamPixels<ushort, 3>(image, seam, output); break;
+    case CV_16UC4: removeSeamPixels<ushort, 4>(image, seam, output); break;
+    case CV_32FC1: removeSeamPixels<float, 1>(image, seam, output); break;
+    case CV_32FC3: removeSeamPixels<float, 3>(image, seam, output); break;
+    case CV_32FC4: removeSeamPixels<float, 4>(image, seam, output); break;
+    case CV_32SC1: removeSeamPixels<int, 1>(image, seam, output); break;
+    default:       removeSeamBytes(image, seam, output); break;
+    }
+
+    // Update the original image with the seam removed
+    image = output;
+}
+
+// Function to remove a horizontal seam from an image of any pixel type
+// The seam holds one row index per column; pixels below it move up by one
+void removeHorizontalSeam(Mat& image, const vector<int>& seam) {
+    int rows = image.rows;
+    int cols = image.cols;
+    size_t pixel_size = image.elemSize();
+    Mat output(rows - 1, cols, image.type());
+
+    for (int i = 0; i < rows - 1; i++) {
+        uchar* dst = output.ptr<uchar>(i);
+
+        // Copy runs of columns that take this output row from the same source row
+        for (int j = 0; j < cols;) {
+            bool shifted = i >= seam[j];
+            int run = j + 1;
+            while (run < cols && (i >= seam[run]) == shifted)
+                run++;
+
+            const uchar* src = image.ptr<uchar>(shifted ? i + 1 : i);
+            memcpy(dst + j * pixel_size, src + j * pixel_size, (run - j) * pixel_size);
+            j = run;
+        }
+    }
+
+    // Update the original image with the seam removed
+    image = output;
+}
+
+// Function to backtrack the minimum energy vertical seam through a cumulative energy map
+// The total energy of the seam is stored in seam_cost when given
+vector<int> backtrackVerticalSeam(const Mat& M, int* seam_cost = nullptr) {
+    int rows = M.rows;
+    int cols = M.cols;
+
+    vector<int> seam(rows);
+    int min_idx = 0;
+    int min_val = M.at<int>(rows - 1, 0);
+
+    // Find the position in the last row with the minimum cumulative energy
+    for (int j = 1; j < cols; j++) {
+        if (M.at<int>(rows - 1, j) < min_val) {
+            min_val = M.at<int>(rows - 1, j);
+            min_idx = j;
+        }
+    }
+    seam[rows - 1] = min_idx;
+    if (seam_cost)
+        *seam_cost = min_val;
+
+    // Trace the seam path from bottom to top
+    for (int i = rows - 2; i >= 0; i--) {
+        int prev_x = seam[i + 1];
+        int min_energy = M.at<int>(i, prev_x);
+        min_idx = prev_x;
+
+        // Check the top-left neighbor
+        if (prev_x > 0 && M.at<int>(i, prev_x - 1) < min_energy) {
+            min_energy = M.at<int>(i, prev_x - 1);
+            min_idx = prev_x - 1;
+        }
+
+        // Check the top-right neighbor
+        if (prev_x < cols - 1 && M.at<int>(i, prev_x + 1) < min_energy) {
+            min_energy = M.at<int>(i, prev_x + 1);
+            min_idx = prev_x + 1;
+        }
+
+        // Update the seam path
+        seam[i] = min_idx;
+    }
+
+    return seam;
+}
+
+// Function to get the energy of a protected pixel in an image of the given number of rows
+// Any seam crossing one costs at least this much, while an unprotected seam costs at most 255 per row and
+// stays below it. The floor of 1 << 24 keeps the historical value for images up to 65793 rows; past about
+// 8.4 million rows the value saturates at INT_MAX and the two can no longer be told apart.
+int protectedEnergy(int rows) {
+    int64 energy = max((int64)1 << 24, 255 * (int64)rows + 1);
+    return (int)min(energy, (int64)INT_MAX);
+}
+
+// Cooperative cancellation flag shared between a carving job and whoever may stop it
+// Carving code polls it between seams and between row bands of the dynamic programming pass
+class CancellationToken {
+public:
+    void cancel() { cancelled.store(true, memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(memory_order_relaxed); }
+
+private:
+    atomic<bool> cancelled{ false };
+};
+
+// Rows of the cumulative energy map filled between two polls of a cancellation token
+const int CANCEL_CHECK_ROWS = 32;
+
+// Function to compute the cumulative energy map of vertical seams with column stripes run in parallel
+// Rows are filled in bands; each stripe recomputes in a local buffer the halo of neighbouring columns its
+// band depends on, so the threads meet once per band instead of once per row.
+// Returns an empty map when the cancellation token fires between two bands.
+Mat computeCumulativeEnergyMapParallel(const Mat& energy_map, const CancellationToken* cancel = nullptr,
+                                       int band_rows = CANCEL_CHECK_ROWS) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+
+    Mat M(rows, cols, CV_32S);
+    energy_map.row(0).convertTo(M.row(0), CV_32S);
+
+    const CarveKernels& kernels = carveKernels();
+
+    // Stripes much wider than a band keep the recomputed halo small
+    int num_stripes = max(1, min(getNumThreads(), cols / (8 * band_rows)));
+
+    for (int band_start = 1; band_start < rows; band_start += band_rows) {
+        int band_end = min(rows, band_start + band_rows);
+        if (cancel && cancel->isCancelled())
+            return Mat();
+
+        parallel_for_(Range(0, num_stripes), [&](const Range& range) {
+            vector<int> previous, current;
+            for (int s = range.start; s < range.end; s++) {
+                int stripe_start = (int)((int64)s * cols / num_stripes);
+                int stripe_end = (int)((int64)(s + 1) * cols / num_stripes);
+
+                // The first band row needs the row above one column beyond its halo on either side
+                int halo = band_end - 1 - band_start;
+                int previous_lo = max(0, stripe_start - halo - 1);
+                const int* above = M.ptr<int>(band_start - 1);
+                previous.assign(above + previous_lo, above + min(cols, stripe_end + halo + 1));
+
+                for (int i = band_start; i < band_end; i++) {
+                    // The halo shrinks by one column per row down to the stripe itself on the last band row
+                    halo = band_end - 1 - i;
+                    int lo = max(0, stripe_start - halo);
+                    int hi = min(cols, stripe_end + halo);
+                    const uchar* energy = energy_map.ptr<uchar>(i);
+                    current.resize(hi - lo);
+
+                    // The image edges have one parent less; everything between goes through the kernel
+                    int first = max(lo, 1);
+                    int last = min(hi, cols - 1);
+                    if (lo < first)
+                        current[0] = energy[0] + min(previous[-previous_lo], previous[1 - previous_lo]);
+                    if (first < last)
+                        kernels.cumulativeRow(&previous[first - previous_lo], energy + first, &current[first - lo], last - first);
+                    if (last < hi)
+                        current[last - lo] = energy[last] + min(previous[last - 1 - previous_lo], previous[last - previous_lo]);
+
+                    // Only the stripe's own columns are published
+                    memcpy(M.ptr<int>(i) + stripe_start, &current[stripe_start - lo], (stripe_end - stripe_start) * sizeof(int));
+                    swap(previous, current);
+                    previous_lo = lo;
+                }
+            }
+        });
+    }
+
+    return M;
+}
+
+// Function to fill one row of the cumulative energy map of vertical seams from the row above it
+void computeCumulativeEnergyRow(const int* above, const uchar* energy, int* row, int cols) {
+    if (cols == 1) {
+        row[0] = energy[0] + above[0];
+        return;
+    }
+
+    // Only the edges need bounds checks; the rest of the row goes through the kernel
+    row[0] = energy[0] + min(above[0], above[1]);
+    carveKernels().cumulativeRow(above + 1, energy + 1, row + 1, cols - 2);
+    row[cols - 1] = energy[cols - 1] + min(above[cols - 2], above[cols - 1]);
+}
+
+// Function to fill one row of the cumulative energy map of vertical seams with protected pixels
+// Pixels whose mask is set cost protected_energy; sums saturate at INT_MAX, since below a large protected
+// region all three parents may already be saturated
+void computeCumulativeEnergyRowMasked(const int* above, const uchar* energy, const uchar* mask, int protected_energy,
+                                      int* row, int cols) {
+    auto saturatedSum = [&](int j, int min_energy) {
+        int pixel_energy = mask[j] ? protected_energy : energy[j];
+        return min_energy > INT_MAX - pixel_energy ? INT_MAX : pixel_energy + min_energy;
+    };
+    if (cols == 1) {
+        row[0] = saturatedSum(0, above[0]);
+        return;
+    }
+
+    // Only the edges need bounds checks; the rest of the row goes through the kernel
+    row[0] = saturatedSum(0, min(above[0], above[1]));
+    carveKernels().cumulativeRowMasked(above + 1, energy + 1, mask + 1, protected_energy, row + 1, cols - 2);
+    row[cols - 1] = saturatedSum(cols - 1, min(above[cols - 2], above[cols - 1]));
+}
+
+// Function to compute the cumulative energy map of vertical seams by dynamic programming
+// Pixels set in the optional protect mask cost protectedEnergy(rows), folded in while the map is filled;
+// sums saturate at INT_MAX so long runs of protected pixels cannot overflow.
+// Returns an empty map when the optional cancellation token fires.
+Mat computeCumulativeEnergyMap(const Mat& energy_map, const Mat& protect_mask = Mat(), const CancellationToken* cancel = nullptr) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+    bool protect = !protect_mask.empty();
+    CV_Assert(!protect || (protect_mask.type() == CV_8UC1 && protect_mask.size() == energy_map.size()));
+
+    // Wide images without a protect mask are worth splitting across threads
+    if (!protect && cols >= 1024 && rows > 1 && getNumThreads() > 1)
+        return computeCumulativeEnergyMapParallel(energy_map, cancel);
+
+    // Initialize the cumulative energy map with zeros
+    Mat M = Mat::zeros(rows, cols, CV_32S);
+
+    // Copy the first row of the energy map to the cumulative energy map
+    energy_map.row(0).convertTo(M.row(0), CV_32S);
+    int protected_energy = protectedEnergy(rows);
+    if (protect) {
+        const uchar* protected_row = protect_mask.ptr<uchar>(0);
+        int* row = M.ptr<int>(0);
+        for (int j = 0; j < cols; j++) {
+            if (protected_row[j])
+                row[j] = protected_energy;
+        }
+    }
+
+    // Compute the cumulative energy map by dynamic programming
+    for (int i = 1; i < rows; i++) {
+        if (cancel && i % CANCEL_CHECK_ROWS == 0 && cancel->isCancelled())
+            return Mat();
+
+        if (!protect)
+            computeCumulativeEnergyRow(M.ptr<int>(i - 1), energy_map.ptr<uchar>(i), M.ptr<int>(i), cols);
+        else
+            computeCumulativeEnergyRowMasked(M.ptr<int>(i - 1), energy_map.ptr<uchar>(i), protect_mask.ptr<uchar>(i),
+                                             protected_energy, M.ptr<int>(i), cols);
+    }
+
+    return M;
+}
+
+// Function to find the vertical seam with the minimum cumulative energy using dynamic programming
+// The total energy of the seam is stored in seam_cost when given; the seam is empty when cancelled
+vector<int> findVerticalSeamDP(const Mat& energy_map, int* seam_cost = nullptr, const Mat& protect_mask = Mat(),
+                               const CancellationToken* cancel = nullptr) {
+    Mat M = computeCumulativeEnergyMap(energy_map, protect_mask, cancel);
+    if (M.empty())
+        return vector<int>();
+
+    // Backtrack to find the path of the seam with the minimum energy
+    return backtrackVerticalSeam(M, seam_cost);
+}
+
+// Function to find and remove a vertical seam using dynamic programming
+void removeVerticalSeamDP(Mat& image) {
+    // Compute the energy map of the current image
+    Mat energy_map = computeEnergyMap(image);
+
+    // Find the seam and remove it from the image
+    removeVerticalSeam(image, findVerticalSeamDP(energy_map));
+}
+
+// Function to remove up to num_seams vertical seams with any vertical seam remover while keep_going() holds
+// keep_going is asked once before every seam; returns the number of seams removed.
+// Extra arguments of the remover (such as the beam width) follow it.
+template <typename KeepGoing, typename... Args>
+int removeVerticalSeamsWhile(Mat& image, int num_seams, KeepGoing keep_going, void (*remove_seam)(Mat&, Args...),
+                             Args... args) {
+    int removed = 0;
+    while (removed < num_seams && keep_going()) {
+        remove_seam(image, args...);
+        removed++;
+    }
+    return removed;
+}
+
+// Function to remove up to num_seams horizontal seams while keep_going() holds, returning how many were removed
+// The image is transposed once, carved with the vertical engine and transposed back once. keep_going is asked
+// once before every seam, the first time before transposing, so a phase that cannot start costs nothing.
+template <typename KeepGoing, typename... Args>
+int removeHorizontalSeamsWhile(Mat& image, int num_seams, KeepGoing keep_going, void (*remove_seam)(Mat&, Args...),
+                               Args... args) {
+    if (num_seams <= 0 || !keep_going())
+        return 0;
+
+    // Transpose the image once for the whole phase
+    Mat transposed_image;
+    transpose(image, transposed_image);
+
+    // Remove the seams as vertical seams of the transposed image
+    remove_seam(transposed_image, args...);
+    int removed = 1 + removeVerticalSeamsWhile(transposed_image, num_seams - 1, keep_going, remove_seam, args...);
+
+    // Transpose the image back to its original orientation
+    transpose(transposed_image, image);
+    return removed;
+}
+
+// Function to remove a whole phase of horizontal seams with any vertical seam remover
+template <typename... Args>
+void removeHorizontalSeams(Mat& image, int num_seams, void (*remove_seam)(Mat&, Args...), Args... args) {
+    removeHorizontalSeamsWhile(image, num_seams, []() { return true; }, remove_seam, args...);
+}
+
+// Function to find and remove a vertical seam restricted to a region of interest
+// Energy, DP and backtracking only touch the ROI (plus one pixel of Sobel context). Rows above and
+// below the ROI lose the column where the seam enters and leaves it, so they shift rigidly. Pixels
+// right of the seam are moved with one bulk copy per row and the image keeps its buffer, narrowed
+// by one column, so the caller's pixels are modified in place. The ROI loses one column as well.
+void removeVerticalSeamDP(Mat& image, Rect& roi) {
+    roi &= Rect(0, 0, image.cols, image.rows);
+    CV_Assert(roi.width > 1 && roi.height > 0);
+
+    // Energy of the ROI, computed with its neighbouring pixels as context
+    Rect context = Rect(roi.x - 1, roi.y - 1, roi.width + 2, roi.height + 2) & Rect(0, 0, image.cols, image.rows);
+    Mat energy_map = computeEnergyMap(image(context))(roi - context.tl());
+
+    // Find the seam inside the ROI and convert it to image columns
+    vector<int> roi_seam = findVerticalSeamDP(energy_map);
+    vector<int> seam(image.rows);
+    for (int i = 0; i < image.rows; i++) {
+        int k = min(max(i - roi.y, 0), roi.height - 1);
+        seam[i] = roi.x + roi_seam[k];
+    }
+
+    // Shift the pixels right of the seam left by one, row by row
+    size_t pixel_size = image.elemSize();
+    for (int i = 0; i < image.rows; i++) {
+        uchar* row = image.ptr<uchar>(i);
+        size_t idx = seam[i];
+        memmove(row + idx * pixel_size, row + (idx + 1) * pixel_size, (image.cols - idx - 1) * pixel_size);
+    }
+
+    image = image.colRange(0, image.cols - 1);
+    roi.width--;
+}
+
+// Function to remove a whole phase of vertical seams inside a region of interest
+void removeVerticalSeamsDP(Mat& image, Rect roi, int num_seams) {
+    for (int i = 0; i < num_seams; i++) {
+        removeVerticalSeamDP(image, roi);
+    }
+}
+
+// Function to remove a whole phase of horizontal seams inside a region of interest
+// The image is transposed once, carved with the vertical ROI engine and transposed back once
+void removeHorizontalSeamsDP(Mat& image, Rect roi, int num_seams) {
+    if (num_seams <= 0)
+        return;
+
+    Mat transposed_image;
+    transpose(image, transposed_image);
+    removeVerticalSeamsDP(transposed_image, Rect(roi.y, roi.x, roi.height, roi.width), num_seams);
+    transpose(transposed_image, image);
+}
+
+// Function to find a vertical seam using a greedy algorithm
+// The seam starts at the given top row column, or at the top row pixel with the minimum energy
+vector<int> findVerticalSeamGreedy(const Mat& energy_map, int start = -1) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+
+    // Initialize the seam path
+    vector<int> seam(rows);
+
+    // Start from the top row and find the pixel with the minimum energy
+    if (start < 0) {
+        double min_val;
+        Point min_loc;
+        minMaxLoc(energy_map.row(0), &min_val, nullptr, &min_loc, nullptr);
+        start = min_loc.x;
+    }
+    seam[0] = start;
+
+    // Greedily find the seam path by selecting the minimum energy neighbor at each step
+    for (int i = 1; i < rows; i++) {
+        int prev_x = seam[i - 1];
+        int min_energy = energy_map.at<uchar>(i, prev_x);
+        int min_idx = prev_x;
+
+        // Check the left neighbor
+        if (prev_x > 0 && energy_map.at<uchar>(i, prev_x - 1) < min_energy) {
+            min_energy = energy_map.at<uchar>(i, prev_x - 1);
+            min_idx = prev_x - 1;
+        }
+
+        // Check the right neighbor
+        if (prev_x < cols - 1 && energy_map.at<uchar>(i, prev_x + 1) < min_energy) {
+            min_energy = energy_map.at<uchar>(i, prev_x + 1);
+            min_idx = prev_x + 1;
+        }
+
+        // Update the seam path
+        seam[i] = min_idx;
+    }
+
+    return seam;
+}
+
+// Function to find and remove a vertical seam using a greedy algorithm
+void removeVerticalSeamGreedy(Mat& image) {
+    // Compute the energy map of the current image
+    Mat energy_map = computeEnergyMap(image);
+
+    // Find the seam and remove it from the image
+    removeVerticalSeam(image, findVerticalSeamGreedy(energy_map));
+}
+
+// Function to find a vertical seam by tracing a greedy path from every top row column at once
+// All paths advance one row at a time; with SIMD each lane holds the column and accumulated energy
+// of one path and gathers its three candidate neighbours. The path with the lowest total wins.
+vector<int> findVerticalSeamMultiGreedy(const Mat& energy_map) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+
+    // Current column and accumulated energy of every path, padded to whole vectors
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = VTraits<v_int32>::vlanes();
+#else
+    const int lanes = 1;
+#endif
+    int padded = (cols + lanes - 1) / lanes * lanes;
+    vector<int> position(padded), cost(padded);
+    const uchar* first_row = energy_map.ptr<uchar>(0);
+    for (int j = 0; j < padded; j++) {
+        position[j] = min(j, cols - 1);
+        cost[j] = first_row[position[j]];
+    }
+
+    // Energy of the current row with a sentinel column on each side that is never the minimum
+    const int sentinel = 1 << 20;
+    vector<int> row_energy(cols + 2, sentinel);
+
+    for (int i = 1; i < rows; i++) {
+        const uchar* energy = energy_map.ptr<uchar>(i);
+        for (int j = 0; j < cols; j++)
+            row_energy[j + 1] = energy[j];
+        const int* left = row_energy.data();
+        const int* center = left + 1;
+        const int* right = left + 2;
+
+        int j = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        const v_int32 minus_one = vx_setall_s32(-1), plus_one = vx_setall_s32(1), zero = vx_setzero_s32();
+        for (; j < padded; j += lanes) {
+            v_int32 x = vx_load(&position[j]);
+
+            // Same preference as the single greedy trace: straight down, then left, then right
+            v_int32 min_energy = v_lut(center, x), step = zero;
+            v_int32 candidate = v_lut(left, x);
+            v_int32 better = v_lt(candidate, min_energy);
+            min_energy = v_select(better, candidate, min_energy);
+            step = v_select(better, minus_one, step);
+            candidate = v_lut(right, x);
+            better = v_lt(candidate, min_energy);
+            min_energy = v_select(better, candidate, min_energy);
+            step = v_select(better, plus_one, step);
+
+            v_store(&position[j], v_add(x, step));
+            v_store(&cost[j], v_add(vx_load(&cost[j]), min_energy));
+        }
+#endif
+        for (; j < padded; j++) {
+            int x = position[j];
+            int min_energy = center[x], step = 0;
+            if (left[x] < min_energy) {
+                min_energy = left[x];
+                step = -1;
+            }
+            if (right[x] < min_energy) {
+                min_energy = right[x];
+                step = 1;
+            }
+            position[j] = x + step;
+            cost[j] += min_energy;
+        }
+    }
+
+    // Trace the winning path again to recover its columns
+    int best_start = (int)(min_element(cost.begin(), cost.begin() + cols) - cost.begin());
+    return findVerticalSeamGreedy(energy_map, best_start);
+}
+
+// Function to find and remove a vertical seam using the multi-start greedy algorithm
+void removeVerticalSeamMultiGreedy(Mat& image) {
+    // Compute the energy map of the current image
+    Mat energy_map = computeEnergyMap(image);
+
+    // Find the seam and remove it from the image
+    removeVerticalSeam(image, findVerticalSeamMultiGreedy(energy_map));
+}
+
+// Function to find a vertical seam with a beam search keeping the best beam_width partial seams per row
+// Each beam extends to its three lower neighbours, beams reaching the same pixel are merged into the
+// cheapest one and the best beam_width survive. A width of 1 is the greedy algorithm; wider beams
+// approach dynamic programming at O(beam_width * rows) work.
+vector<int> findVerticalSeamBeam(const Mat& energy_map, int beam_width) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+    beam_width = max(1, min(beam_width, cols));
+
+    // A partial seam ending at column x of the current row
+    struct Beam {
+        int x;
+        int cost;
+        int parent;  // Index of the beam it extends in the previous row
+        int order;   // Candidate order, used to break ties like the greedy algorithm
+    };
+
+    // Surviving beams of every row, kept for backtracking
+    vector<vector<Beam>> beams(rows);
+    auto byCost = [](const Beam& a, const Beam& b) {
+        return a.cost < b.cost || (a.cost == b.cost && a.order < b.order);
+    };
+
+    // Start from the beam_width lowest energy pixels of the top row
+    const uchar* first_row = energy_map.ptr<uchar>(0);
+    for (int j = 0; j < cols; j++)
+        beams[0].push_back({ j, first_row[j], -1, j });
+    partial_sort(beams[0].begin(), beams[0].begin() + beam_width, beams[0].end(), byCost);
+    beams[0].resize(beam_width);
+
+    // Index of the candidate that currently owns each pixel of the row being built
+    vector<int> owner(cols, -1);
+    vector<Beam> candidates;
+
+    for (int i = 1; i < rows; i++) {
+        const uchar* energy = energy_map.ptr<uchar>(i);
+        candidates.clear();
+
+        // Extend every beam straight down, then left, then right
+        for (int b = 0; b < (int)beams[i - 1].size(); b++) {
+            const Beam& beam = beams[i - 1][b];
+            const int steps[3] = { 0, -1, 1 };
+            for (int step : steps) {
+                int x = beam.x + step;
+                if (x < 0 || x >= cols)
+                    continue;
+
+                Beam candidate = { x, beam.cost + energy[x], b, (int)candidates.size() };
+                if (owner[x] < 0) {
+                    owner[x] = (int)candidates.size();
+                    candidates.push_back(candidate);
+                }
+                else if (candidate.cost < candidates[owner[x]].cost) {
+                    // Merge with the beam already on this pixel, keeping the cheaper one
+                    candidate.order = candidates[owner[x]].order;
+                    candidates[owner[x]] = candidate;
+                }
+            }
+        }
+
+        // Keep the cheapest beams and release the pixels for the next row
+        for (const Beam& candidate : candidates)
+            owner[candidate.x] = -1;
+        int kept = min(beam_width, (int)candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + kept, candidates.end(), byCost);
+        beams[i].assign(candidates.begin(), candidates.begin() + kept);
+    }
+
+    // Backtrack from the cheapest beam of the last row
+    vector<int> seam(rows);
+    int b = (int)(min_element(beams[rows - 1].begin(), beams[rows - 1].end(), byCost) - beams[rows - 1].begin());
+    for (int i = rows - 1; i >= 0; i--) {
+        seam[i] = beams[i][b].x;
+        b = beams[i][b].parent;
+    }
+
+    return seam;
+}
+
+// Function to find and remove a vertical seam using beam search
+void removeVerticalSeamBeam(Mat& image, int beam_width) {
+    // Compute the energy map of the current image
+    Mat energy_map = computeEnergyMap(image);
+
+    // Find the seam and remove it from the image
+    removeVerticalSeam(image, findVerticalSeamBeam(energy_map, beam_width));
+}
+
+// Function to find up to k pixel-disjoint vertical seams from a single dynamic programming pass
+// Seams are traced back from the lowest entries of the last row of the cumulative map; every step
+// takes the cheapest upper neighbour not claimed by an earlier seam, and a seam that runs out of
+// free neighbours is dropped. No cumulative map is recomputed between seams.
+vector<vector<int>> findVerticalSeamsDP(const Mat& energy_map, int k) {
+    Mat M = computeCumulativeEnergyMap(energy_map);
+    int rows = M.rows;
+    int cols = M.cols;
+
+    // Candidate end points by increasing cumulative energy
+    vector<int> ends(cols);
+    for (int j = 0; j < cols; j++)
+        ends[j] = j;
+    const int* last_row = M.ptr<int>(rows - 1);
+    stable_sort(ends.begin(), ends.end(), [&](int a, int b) { return last_row[a] < last_row[b]; });
+
+    Mat used = Mat::zeros(rows, cols, CV_8U);
+    vector<vector<int>> seams;
+    vector<int> seam(rows);
+
+    for (int end : ends) {
+        if ((int)seams.size() >= k)
+            break;
+        if (used.at<uchar>(rows - 1, end))
+            continue;
+
+        // Trace the seam path from bottom to top through unclaimed pixels
+        seam[rows - 1] = end;
+        bool complete = true;
+        for (int i = rows - 2; i >= 0 && complete; i--) {
+            int prev_x = seam[i + 1];
+            int min_idx = -1;
+            for (int x = max(0, prev_x - 1); x <= min(cols - 1, prev_x + 1); x++) {
+                if (!used.at<uchar>(i, x) && (min_idx < 0 || M.at<int>(i, x) < M.at<int>(i, min_idx)))
+                    min_idx = x;
+            }
+            complete = min_idx >= 0;
+            seam[i] = min_idx;
+        }
+        if (!complete)
+            continue;
+
+        // Claim the pixels of the seam
+        for (int i = 0; i < rows; i++)
+            used.at<uchar>(i, seam[i]) = 1;
+        seams.push_back(seam);
+    }
+
+    return seams;
+}
+
+// Function to insert a new pixel after every marked pixel of each row
+// The new pixel is the average of the marked pixel and its right neighbour (or itself at the border)
+template <typename T>
+void insertSeamPixels(const Mat& image, const Mat& marked, Mat& output) {
+    int cols = image.cols;
+    int cn = image.channels();
+
+    for (int i = 0; i < image.rows; i++) {
+        const T* src = image.ptr<T>(i);
+        const uchar* mark = marked.ptr<uchar>(i);
+        T* dst = output.ptr<T>(i);
+
+        for (int j = 0; j < cols; j++) {
+            // Copy the original pixel
+            for (int c = 0; c < cn; c++)
+                *dst++ = src[j * cn + c];
+
+            // Follow it with the averaged pixel when it lies on a seam
+            if (mark[j]) {
+                int right = min(j + 1, cols - 1);
+                for (int c = 0; c < cn; c++)
+                    *dst++ = saturate_cast<T>(((double)src[j * cn + c] + src[right * cn + c]) * 0.5);
+            }
+        }
+    }
+}
+
+// Function to enlarge an image by inserting vertical seams (Avidan and Shamir)
+// Seams are found k at a time on the current image so they spread over distinct low energy paths
+// instead of stretching the same one; each batch adds at most half the current width, so
+// enlargements above 50% take several batches of one dynamic programming pass each
+void insertVerticalSeams(Mat& image, int num_seams) {
+    while (num_seams > 0) {
+        int batch = min(num_seams, max(1, image.cols / 2));
+        vector<vector<int>> seams = findVerticalSeamsDP(computeEnergyMap(image), batch);
+
+        // Mark the seam pixels of the current image, at most one seam per pixel
+        Mat marked = Mat::zeros(image.size(), CV_8U);
+        for (const vector<int>& seam : seams) {
+            for (int i = 0; i < image.rows; i++)
+                marked.at<uchar>(i, seam[i]) = 1;
+        }
+
+        // Create an output image with one more column per seam
+        Mat output(image.rows, image.cols + (int)seams.size(), image.type());
+        switch (image.depth()) {
+        case CV_8U:  insertSeamPixels<uchar>(image, marked, output); break;
+        case CV_8S:  insertSeamPixels<schar>(image, marked, output); break;
+        case CV_16U: insertSeamPixels<ushort>(image, marked, output); break;
+        case CV_16S: insertSeamPixels<short>(image, marked, output); break;
+        case CV_32S: insertSeamPixels<int>(image, marked, output); break;
+        case CV_32F: insertSeamPixels<float>(image, marked, output); break;
+        case CV_64F: insertSeamPixels<double>(image, marked, output); break;
+        default:     CV_Error(Error::StsUnsupportedFormat, "Unsupported image depth for seam insertion");
+        }
+
+        image = output;
+        num_seams -= (int)seams.size();
+    }
+}
+
+// Function to enlarge an image by inserting horizontal seams
+// The image is transposed once for all batches
+void insertHorizontalSeams(Mat& image, int num_seams) {
+    if (num_seams <= 0)
+        return;
+
+    Mat transposed_image;
+    transpose(image, transposed_image);
+    insertVerticalSeams(transposed_image, num_seams);
+    transpose(transposed_image, image);
+}
+
+// Function to find the cheapest vertical seam inside a column band, rewarding pixels of a removal mask
+// Energy is only computed for the band (plus one column of Sobel context) and the DP never leaves it.
+// Every masked pixel is worth more than any unmasked seam could cost, so the seam goes through as
+// much of the object as possible.
+vector<int> findVerticalSeamInBand(const Mat& image, const Mat& removal_mask, int band_lo, int band_hi) {
+    int rows = image.rows;
+    int width = band_hi - band_lo + 1;
+
+    // Energy of the band, computed with its neighbouring columns as context
+    int context_lo = max(0, band_lo - 1), context_hi = min(image.cols - 1, band_hi + 1);
+    Mat context_energy = computeEnergyMap(image.colRange(context_lo, context_hi + 1));
+    Mat energy_map = context_energy.colRange(band_lo - context_lo, band_lo - context_lo + width);
+    Mat mask = removal_mask.colRange(band_lo, band_hi + 1);
+
+    // A masked pixel outweighs a whole seam of maximum energy
+    const int64 removal_bonus = 256 * (int64)rows;
+
+    // Cumulative energy of the band, in 64 bits since the bonus accumulates over rows
+    vector<int64> M((size_t)rows * width);
+    for (int i = 0; i < rows; i++) {
+        const uchar* energy = energy_map.ptr<uchar>(i);
+        const uchar* masked = mask.ptr<uchar>(i);
+        int64* row = &M[(size_t)i * width];
+        const int64* above = row - width;
+
+        for (int j = 0; j < width; j++) {
+            int64 value = energy[j] - (masked[j] ? removal_bonus : 0);
+            if (i > 0) {
+                int64 min_energy = above[j];
+                if (j > 0)
+                    min_energy = min(min_energy, above[j - 1]);
+                if (j < width - 1)
+                    min_energy = min(min_energy, above[j + 1]);
+                value += min_energy;
+            }
+            row[j] = value;
+        }
+    }
+
+    // Backtrack from the cheapest end point, staying inside the band
+    vector<int> seam(rows);
+    const int64* last_row = &M[(size_t)(rows - 1) * width];
+    seam[rows - 1] = (int)(min_element(last_row, last_row + width) - last_row);
+    for (int i = rows - 2; i >= 0; i--) {
+        const int64* row = &M[(size_t)i * width];
+        int prev_x = seam[i + 1];
+        int min_idx = prev_x;
+        if (prev_x > 0 && row[prev_x - 1] < row[min_idx])
+            min_idx = prev_x - 1;
+        if (prev_x < width - 1 && row[prev_x + 1] < row[min_idx])
+            min_idx = prev_x + 1;
+        seam[i] = min_idx;
+    }
+
+    // Convert the seam to image columns
+    for (int i = 0; i < rows; i++)
+        seam[i] += band_lo;
+    return seam;
+}
+
+// Function to erase the object under a removal mask by carving seams through it
+// Seams run along the shorter side of the object's bounding box. The DP is limited to the columns
+// spanned by what remains of the object plus a margin, so the band shrinks as the object disappears.
+// With re_expand the image is enlarged back to its original size by seam insertion afterwards.
+Mat removeObject(const Mat& image, const Mat& removal_mask, int margin = 8, bool re_expand = false) {
+    CV_Assert(removal_mask.type() == CV_8UC1 && removal_mask.size() == image.size());
+    Mat carved = image.clone();
+    Mat mask = removal_mask.clone();
+
+    Rect box = boundingRect(mask);
+    if (box.area() == 0)
+        return carved;
+
+    // Horizontal seams are vertical seams of the transposed image
+    bool vertical = box.width <= box.height;
+    if (!vertical) {
+        transpose(carved, carved);
+        transpose(mask, mask);
+        box = Rect(box.y, box.x, box.height, box.width);
+    }
+
+    int removed = 0;
+    while (box.area() > 0) {
+        int band_lo = max(0, box.x - margin);
+        int band_hi = min(carved.cols - 1, box.x + box.width - 1 + margin);
+        vector<int> seam = findVerticalSeamInBand(carved, mask, band_lo, band_hi);
+
+        // Remove the seam from the image and the mask in lockstep
+        removeVerticalSeam(carved, seam);
+        removeVerticalSeam(mask, seam);
+        removed++;
+
+        // What remains of the object lies in its previous box, shifted left by at most one column
+        Rect search = Rect(box.x - 1, box.y, box.width + 1, box.height) & Rect(0, 0, mask.cols, mask.rows);
+        Rect remaining = boundingRect(mask(search));
+        box = remaining.area() > 0 ? remaining + search.tl() : Rect();
+    }
+
+    // Grow back to the original size
+    if (re_expand)
+        insertVerticalSeams(carved, removed);
+
+    if (!vertical)
+        transpose(carved, carved);
+    return carved;
+}
+
+// Function to check whether a target size can be reached without carving through protected pixels
+// Every row must keep enough unprotected pixels for the vertical seams and every column for the
+// horizontal ones, and the protected area has to fit in the target. These are necessary conditions,
+// checked before any seam is carved; the reason is stored in report when the target is unreachable.
+bool isProtectedTargetReachable(const Mat& protect_mask, int new_width, int new_height, string& report) {
+    Mat protected_pixels = protect_mask > 0;
+
+    // Most protected pixels in any row and in any column
+    Mat per_row, per_column;
+    reduce(protected_pixels / 255, per_row, 1, REDUCE_SUM, CV_32S);
+    reduce(protected_pixels / 255, per_column, 0, REDUCE_SUM, CV_32S);
+    double max_per_row, max_per_column;
+    Point row_loc, column_loc;
+    minMaxLoc(per_row, nullptr, &max_per_row, nullptr, &row_loc);
+    minMaxLoc(per_column, nullptr, &max_per_column, nullptr, &column_loc);
+
+    if (max_per_row > new_width) {
+        report = format("row %d has %d protected pixels, more than the target width %d",
+                        row_loc.y, (int)max_per_row, new_width);
+        return false;
+    }
+    if (max_per_column > new_height) {
+        report = format("column %d has %d protected pixels, more than the target height %d",
+                        column_loc.x, (int)max_per_column, new_height);
+        return false;
+    }
+    int protected_area = countNonZero(protected_pixels);
+    if (protected_area > new_width * new_height) {
+        report = format("%d protected pixels do not fit in %d x %d", protected_area, new_width, new_height);
+        return false;
+    }
+    return true;
+}
+
+// Function to remove vertical seams while keeping protected pixels
+// The protect mask loses the same pixels as the image so it stays aligned. Stops early, returning
+// the number of seams removed, as soon as every remaining seam has to cross a protected pixel.
+int removeVerticalSeamsProtected(Mat& image, Mat& protect_mask, int num_seams) {
+    for (int k = 0; k < num_seams; k++) {
+        int seam_cost;
+        vector<int> seam = findVerticalSeamDP(computeEnergyMap(image), &seam_cost, protect_mask);
+        if (seam_cost >= protectedEnergy(image.rows))
+            return k;
+
+        // Remove the seam from the image and the protect mask in lockstep
+        removeVerticalSeam(image, seam);
+        removeVerticalSeam(protect_mask, seam);
+    }
+    return num_seams;
+}
+
+// Function to carve an image to a smaller size while keeping the pixels of a protect mask
+// Returns false with the reason in report when the target cannot be reached without cutting
+// through protected pixels; image and protect_mask then hold the best partial result
+bool carveProtected(Mat& image, Mat& protect_mask, int new_width, int new_height, string& report) {
+    CV_Assert(protect_mask.type() == CV_8UC1 && protect_mask.size() == image.size());
+    if (!isProtectedTargetReachable(protect_mask, new_width, new_height, report))
+        return false;
+
+    // Vertical phase
+    int num_vertical_seams = image.cols - new_width;
+    int removed = removeVerticalSeamsProtected(image, protect_mask, num_vertical_seams);
+    if (removed < num_vertical_seams) {
+        report = format("only %d of %d vertical seams avoid the protected pixels", removed, num_vertical_seams);
+        return false;
+    }
+
+    // Horizontal phase, transposing the image and the mask once
+    int num_horizontal_seams = image.rows - new_height;
+    Mat transposed_image, transposed_mask;
+    transpose(image, transposed_image);
+    transpose(protect_mask, transposed_mask);
+    removed = removeVerticalSeamsProtected(transposed_image, transposed_mask, num_horizontal_seams);
+    transpose(transposed_image, image);
+    transpose(transposed_mask, protect_mask);
+    if (removed < num_horizontal_seams) {
+        report = format("only %d of %d horizontal seams avoid the protected pixels", removed, num_horizontal_seams);
+        return false;
+    }
+
+    return true;
+}
+
+// Function to carve an image to several target sizes, sharing the vertical phase between them
+// Targets are visited from the widest to the narrowest so the vertical seams are carved once down
+// the common path, with a snapshot taken at every requested width. Each snapshot then gets its own
+// horizontal phase with the same seam remover. Results are returned in the order of the targets.
+vector<Mat> carveToSizes(const Mat& image, const vector<Size>& targets, void (*removeSeam)(Mat&)) {
+    // Visit the targets by decreasing width
+    vector<size_t> order(targets.size());
+    for (size_t k = 0; k < order.size(); k++)
+        order[k] = k;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return targets[a].width > targets[b].width; });
+
+    vector<Mat> results(targets.size());
+    Mat carved = image.clone();
+    for (size_t k : order) {
+        const Size& target = targets[k];
+        CV_Assert(target.width > 0 && target.width <= image.cols && target.height > 0 && target.height <= image.rows);
+
+        // Continue the shared vertical reduction down to this width
+        while (carved.cols > target.width)
+            removeSeam(carved);
+
+        // Every seam removal allocates a new image, so the snapshot is never modified afterwards
+        results[k] = carved.clone();
+        removeHorizontalSeams(results[k], image.rows - target.height, removeSeam);
+    }
+
+    return results;
+}
+
+// Function to remove a vertical seam and report its cost, leaving the input untouched
+Mat carveVerticalSeamDP(const Mat& image, int& seam_cost) {
+    Mat carved = image;
+    removeVerticalSeam(carved, findVerticalSeamDP(computeEnergyMap(image), &seam_cost));
+    return carved;
+}
+
+// Function to remove a horizontal seam and report its cost, leaving the input untouched
+Mat carveHorizontalSeamDP(const Mat& image, int& seam_cost) {
+    Mat transposed_image, carved;
+    transpose(image, transposed_image);
+    transpose(carveVerticalSeamDP(transposed_image, seam_cost), carved);
+    return carved;
+}
+
+// Function to carve an image to a smaller size in the optimal seam order (Avidan's transport map)
+// T(i, j) is the cheapest way to remove i horizontal and j vertical seams. States are evaluated one
+// anti-diagonal i + j = d at a time, in parallel, and only the images of the current diagonal and the
+// one being filled are kept in memory. The optimal order is returned in vertical_steps (true for a vertical seam).
+Mat carveTransportMap(const Mat& image, int new_width, int new_height, vector<bool>* vertical_steps = nullptr,
+                      int64* total_cost = nullptr) {
+    CV_Assert(new_width > 0 && new_width <= image.cols && new_height > 0 && new_height <= image.rows);
+    int r = image.rows - new_height;
+    int c = image.cols - new_width;
+
+    // Cumulative cost and the choice made at every state (1 for a vertical seam, 0 for a horizontal one)
+    vector<int64> T((size_t)(r + 1) * (c + 1), 0);
+    Mat choice = Mat::zeros(r + 1, c + 1, CV_8U);
+
+    // Images of the states on the current diagonal, indexed by i - first row of the diagonal
+    vector<Mat> diagonal(1, image);
+
+    for (int d = 0; d < r + c; d++) {
+        int i_lo = max(0, d - c), i_hi = min(d, r);
+        int next_lo = max(0, d + 1 - c), next_hi = min(d + 1, r);
+
+        // Every state of the next diagonal carves the children of its two parents in parallel and keeps
+        // only the cheaper one, so at most one extra image per thread lives beside the two diagonals
+        vector<Mat> next(next_hi - next_lo + 1);
+        parallel_for_(Range(next_lo, next_hi + 1), [&](const Range& range) {
+            for (int i = range.start; i < range.end; i++) {
+                int j = d + 1 - i;
+                int64 best = numeric_limits<int64>::max();
+                int seam_cost;
+
+                // Arrive with a vertical seam from (i, j - 1)
+                if (j > 0 && i >= i_lo && i <= i_hi) {
+                    next[i - next_lo] = carveVerticalSeamDP(diagonal[i - i_lo], seam_cost);
+                    best = T[(size_t)i * (c + 1) + j - 1] + seam_cost;
+                    choice.at<uchar>(i, j) = 1;
+                }
+
+                // Arrive with a horizontal seam from (i - 1, j)
+                if (i > 0 && i - 1 >= i_lo && i - 1 <= i_hi) {
+                    Mat child = carveHorizontalSeamDP(diagonal[i - 1 - i_lo], seam_cost);
+                    int64 cost = T[(size_t)(i - 1) * (c + 1) + j] + seam_cost;
+                    if (cost < best) {
+                        best = cost;
+                        next[i - next_lo] = child;
+                        choice.at<uchar>(i, j) = 0;
+                    }
+                }
+
+                T[(size_t)i * (c + 1) + j] = best;
+            }
+        });
+
+        // Drop the previous diagonal before moving on
+        diagonal.swap(next);
+    }
+
+    // Trace the optimal order back from (r, c)
+    if (vertical_steps) {
+        vertical_steps->assign(r + c, false);
+        for (int i = r, j = c; i + j > 0;) {
+            bool vertical = choice.at<uchar>(i, j) != 0;
+            (*vertical_steps)[i + j - 1] = vertical;
+            if (vertical)
+                j--;
+            else
+                i--;
+        }
+    }
+    if (total_cost)
+        *total_cost = T.back();
+
+    return r + c == 0 ? image.clone() : diagonal[0];
+}
+
+// Function to carve an image following a given order of vertical and horizontal seams
+// Runs of horizontal seams go through the phase-level API to share a single transpose
+void carveInOrder(Mat& image, const vector<bool>& vertical_steps) {
+    for (size_t k = 0; k < vertical_steps.size();) {
+        size_t run = k;
+        while (run < vertical_steps.size() && vertical_steps[run] == vertical_steps[k])
+            run++;
+
+        if (vertical_steps[k]) {
+            for (size_t s = k; s < run; s++)
+                removeVerticalSeamDP(image);
+        }
+        else {
+            removeHorizontalSeams(image, (int)(run - k), removeVerticalSeamDP);
+        }
+        k = run;
+    }
+}
+
+// Function to approximate the transport map order on a coarse pyramid level
+// The optimal order is computed on the image reduced levels times by pyrDown, stretched to the full
+// number of seams and then followed at full resolution, one DP seam per step
+Mat carveTransportMapPyramid(const Mat& image, int new_width, int new_height, int levels,
+                             vector<bool>* vertical_steps = nullptr) {
+    CV_Assert(new_width > 0 && new_width <= image.cols && new_height > 0 && new_height <= image.rows);
+    int r = image.rows - new_height;
+    int c = image.cols - new_width;
+
+    // Build the coarse level and scale the seam counts to it
+    Mat coarse = image;
+    for (int l = 0; l < levels && coarse.cols > 2 && coarse.rows > 2; l++)
+        pyrDown(coarse, coarse);
+    int coarse_r = min(coarse.rows - 1, (int)cvRound((double)r * coarse.rows / image.rows));
+    int coarse_c = min(coarse.cols - 1, (int)cvRound((double)c * coarse.cols / image.cols));
+
+    vector<bool> coarse_steps;
+    carveTransportMap(coarse, coarse.cols - coarse_c, coarse.rows - coarse_r, &coarse_steps);
+
+    // Stretch the coarse order so the k-th coarse seam of a direction ends at round(k * full / coarse)
+    vector<bool> steps;
+    int coarse_v = 0, coarse_h = 0, emitted_v = 0, emitted_h = 0;
+    for (bool vertical : coarse_steps) {
+        if (vertical) {
+            int target = (int)cvRound((double)++coarse_v * c / coarse_c);
+            for (; emitted_v < target; emitted_v++)
+                steps.push_back(true);
+        }
+        else {
+            int target = (int)cvRound((double)++coarse_h * r / coarse_r);
+            for (; emitted_h < target; emitted_h++)
+                steps.push_back(false);
+        }
+    }
+
+    // Seams lost to rounding at the coarse level go last
+    steps.insert(steps.end(), c - emitted_v, true);
+    steps.insert(steps.end(), r - emitted_h, false);
+
+    Mat carved = image.clone();
+    carveInOrder(carved, steps);
+    if (vertical_steps)
+        vertical_steps->swap(steps);
+    return carved;
+}
+
+// Carver that removes, at every step, whichever of the best vertical and best horizontal seam is cheaper
+// The energy map and both cumulative maps are kept up to date instead of being recomputed at every step:
+//  - the energy only changes in a narrow band around the removed seam, refreshed from a carved grayscale copy
+//  - the cumulative map along the seam direction only changes inside the cone below that band
+//  - the cumulative map across the seam direction is refilled past the first row or column the seam touches;
+//    every path across the seam loses a pixel, so nothing past that line keeps its value
+// The horizontal cumulative map is stored transposed, so both maps are filled along their rows.
+class InterleavedCarver {
+public:
+    // Lines of the energy map refreshed together around a removed seam
+    static const int REFRESH_LINES = 32;
+
+    explicit InterleavedCarver(const Mat& source) {
+        image = source.clone();
+        if (image.channels() != 1)
+            gray = convertToGray(image);
+        energy = computeEnergyMap(image);
+        vertical_M.create(image.rows, image.cols, CV_32S);
+        horizontal_M.create(image.cols, image.rows, CV_32S);
+        recomputeCumulative(vertical_M, false, 0);
+        recomputeCumulative(horizontal_M, true, 0);
+    }
+
+    // Function to carve to the target size, returning the total energy of the removed seams
+    int64 carve(int new_width, int new_height) {
+        CV_Assert(new_width > 0 && new_width <= image.cols && new_height > 0 && new_height <= image.rows);
+        int64 total_cost = 0;
+
+        while (image.cols > new_width || image.rows > new_height) {
+            int vertical_cost = numeric_limits<int>::max(), horizontal_cost = numeric_limits<int>::max();
+            vector<int> vertical_seam, horizontal_seam;
+            if (image.cols > new_width)
+                vertical_seam = backtrackVerticalSeam(vertical_M, &vertical_cost);
+            if (image.rows > new_height)
+                horizontal_seam = backtrackVerticalSeam(horizontal_M, &horizontal_cost);
+
+            // Remove the cheaper seam
+            if (vertical_cost <= horizontal_cost) {
+                removeVertical(vertical_seam);
+                total_cost += vertical_cost;
+            }
+            else {
+                removeHorizontal(horizontal_seam);
+                total_cost += horizontal_cost;
+            }
+        }
+
+        return total_cost;
+    }
+
+    const Mat& result() const {
+        return image;
+    }
+
+private:
+    // Function to remove a vertical seam, one column index per row
+    void removeVertical(const vector<int>& seam) {
+        int first_changed = *min_element(seam.begin(), seam.end());
+
+        removeVerticalSeam(image, seam);
+        if (!gray.empty())
+            removeVerticalSeam(gray, seam);
+        removeVerticalSeam(energy, seam);
+        removeVerticalSeam(vertical_M, seam);
+
+        // Refresh the energy around the seam, a block of rows at a time
+        for (int i = 0; i < image.rows; i += REFRESH_LINES) {
+            Range lines(i, min(image.rows, i + REFRESH_LINES));
+            Range band = seamBand(seam, lines, image.cols);
+            refreshEnergy(Rect(band.start, lines.start, band.size(), lines.size()));
+        }
+
+        updateCumulative(vertical_M, false, seam);
+
+        // Horizontal cumulative rows (image columns) left of the seam keep their values
+        horizontal_M = horizontal_M.rowRange(0, image.cols).clone();
+        recomputeCumulative(horizontal_M, true, max(0, first_changed - 2));
+    }
+
+    // Function to remove a horizontal seam, one row index per column
+    void removeHorizontal(const vector<int>& seam) {
+        int first_changed = *min_element(seam.begin(), seam.end());
+
+        removeHorizontalSeam(image, seam);
+        if (!gray.empty())
+            removeHorizontalSeam(gray, seam);
+        removeHorizontalSeam(energy, seam);
+        removeVerticalSeam(horizontal_M, seam);
+
+        // Refresh the energy around the seam, a block of columns at a time
+        for (int j = 0; j < image.cols; j += REFRESH_LINES) {
+            Range lines(j, min(image.cols, j + REFRESH_LINES));
+            Range band = seamBand(seam, lines, image.rows);
+            refreshEnergy(Rect(lines.start, band.start, lines.size(), band.size()));
+        }
+
+        updateCumulative(horizontal_M, true, seam);
+
+        // Vertical cumulative rows above the seam keep their values
+        vertical_M = vertical_M.rowRange(0, image.rows).clone();
+        recomputeCumulative(vertical_M, false, max(0, first_changed - 2));
+    }
+
+    // Function to get the positions next to a removed seam whose 3x3 neighbourhood changed
+    // Positions are in the carved image along the given lines of the seam, clamped to their length
+    static Range seamBand(const vector<int>& seam, Range lines, int length) {
+        int lo = seam[lines.start], hi = seam[lines.start];
+        for (int k = max(0, lines.start - 1); k < min((int)seam.size(), lines.end + 1); k++) {
+            lo = min(lo, seam[k]);
+            hi = max(hi, seam[k]);
+        }
+        return Range(max(0, lo - 2), min(length, hi + 2));
+    }
+
+    // Function to recompute the energy of a rectangle of the carved image
+    // The rectangle is widened by one pixel of context so the Sobel result matches the full map
+    void refreshEnergy(const Rect& rect) {
+        if (rect.area() <= 0)
+            return;
+        Rect context = Rect(rect.x - 1, rect.y - 1, rect.width + 2, rect.height + 2) & Rect(0, 0, image.cols, image.rows);
+        Mat local = computeEnergyMap((gray.empty() ? image : gray)(context));
+        local(rect - context.tl()).copyTo(energy(rect));
+    }
+
+    // Function to get the energy of positions [lo, hi) of line i of a cumulative map
+    // Lines of the horizontal map are image columns, gathered into a buffer
+    const uchar* lineEnergy(bool transposed, int i, int lo, int hi) {
+        if (!transposed)
+            return energy.ptr<uchar>(i) + lo;
+
+        line_buffer.resize(hi - lo);
+        for (int k = lo; k < hi; k++)
+            line_buffer[k - lo] = energy.at<uchar>(k, i);
+        return line_buffer.data();
+    }
+
+    // Function to compute positions [lo, hi) of line i of a cumulative map from the line above it
+    // line_energy holds the energy of those positions; the values are written to out
+    static void cumulativeSpan(const Mat& M, const uchar* line_energy, int i, int lo, int hi, int* out) {
+        if (i == 0) {
+            for (int j = lo; j < hi; j++)
+                out[j - lo] = line_energy[j - lo];
+            return;
+        }
+
+        // The line ends have one parent less; everything between goes through the kernel
+        const int* above = M.ptr<int>(i - 1);
+        int cols = M.cols;
+        int first = max(lo, 1), last = min(hi, cols - 1);
+        if (lo == 0)
+            out[0] = line_energy[0] + (cols > 1 ? min(above[0], above[1]) : above[0]);
+        if (first < last)
+            carveKernels().cumulativeRow(above + first, line_energy + first - lo, out + first - lo, last - first);
+        if (hi == cols && cols > 1)
+            out[hi - 1 - lo] = line_energy[hi - 1 - lo] + min(above[cols - 2], above[cols - 1]);
+    }
+
+    // Function to recompute a cumulative map from the given line down to the end
+    void recomputeCumulative(Mat& M, bool transposed, int first_line) {
+        for (int i = first_line; i < M.rows; i++)
+            cumulativeSpan(M, lineEnergy(transposed, i, 0, M.cols), i, 0, M.cols, M.ptr<int>(i));
+    }
+
+    // Function to update a cumulative map after the seam was removed along its lines
+    // M holds the previous values shifted past the seam. Each line recomputes the band next to the
+    // seam plus the neighbours of whatever changed on the line above, so work stays inside the cone.
+    void updateCumulative(Mat& M, bool transposed, const vector<int>& seam) {
+        int changed_lo = 0, changed_hi = -1;
+        vector<int> values;
+
+        for (int i = 0; i < M.rows; i++) {
+            Range band = seamBand(seam, Range(i, i + 1), M.cols);
+            int lo = band.start, hi = band.end - 1;
+            if (changed_hi >= changed_lo) {
+                lo = max(0, min(lo, changed_lo - 1));
+                hi = min(M.cols - 1, max(hi, changed_hi + 1));
+            }
+            if (lo > hi) {
+                changed_lo = 0;
+                changed_hi = -1;
+                continue;
+            }
+
+            values.resize(hi - lo + 1);
+            cumulativeSpan(M, lineEnergy(transposed, i, lo, hi + 1), i, lo, hi + 1, values.data());
+
+            // Narrow the change to the positions whose value moved
+            int* row = M.ptr<int>(i);
+            int next_lo = lo;
+            while (next_lo <= hi && values[next_lo - lo] == row[next_lo])
+                next_lo++;
+            int next_hi = hi;
+            while (next_hi >= next_lo && values[next_hi - lo] == row[next_hi])
+                next_hi--;
+            if (next_lo <= next_hi)
+                memcpy(row + next_lo, &values[next_lo - lo], (next_hi - next_lo + 1) * sizeof(int));
+            changed_lo = next_lo;
+            changed_hi = next_hi;
+        }
+    }
+
+    Mat image;
+    Mat gray;                  // Grayscale copy of the carved image, empty when the image is single channel
+    Mat energy;
+    Mat vertical_M;            // Cumulative energy of vertical seams, rows x cols
+    Mat horizontal_M;          // Cumulative energy of horizontal seams, transposed: cols x rows
+    vector<uchar> line_buffer; // Energy of an image column gathered by lineEnergy
+};
+
+// Function to compare the interleaved carve against vertical seams followed by horizontal seams
+// Reports the time of both and the total energy removed, where lower energy means better quality
+Mat compareInterleavedCarve(const Mat& image, int new_width, int new_height) {
+    // Baseline: all vertical seams, then all horizontal seams
+    int64 start = getTickCount();
+    int64 baseline_cost = 0;
+    int seam_cost;
+    Mat baseline = image;
+    while (baseline.cols > new_width) {
+        baseline = carveVerticalSeamDP(baseline, seam_cost);
+        baseline_cost += seam_cost;
+    }
+    Mat transposed_image;
+    transpose(baseline, transposed_image);
+    while (transposed_image.cols > new_height) {
+        transposed_image = carveVerticalSeamDP(transposed_image, seam_cost);
+        baseline_cost += seam_cost;
+    }
+    double baseline_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    // Interleaved: the cheaper direction at every step
+    start = getTickCount();
+    InterleavedCarver carver(image);
+    int64 interleaved_cost = carver.carve(new_width, new_height);
+    double interleaved_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    cout << "Vertical then horizontal: " << baseline_ms << " ms, removed energy " << baseline_cost << endl;
+    cout << "Interleaved:              " << interleaved_ms << " ms, removed energy " << interleaved_cost << endl;
+    return carver.result();
+}
+
+// Function to remove several pixel-disjoint vertical seams of the same image in one pass
+void removeVerticalSeams(Mat& image, const vector<vector<int>>& seams) {
+    if (seams.empty())
+        return;
+
+    // Mark the seam pixels, then keep every unmarked pixel of each row
+    Mat marked = Mat::zeros(image.size(), CV_8U);
+    for (const vector<int>& seam : seams) {
+        for (int i = 0; i < image.rows; i++)
+            marked.at<uchar>(i, seam[i]) = 1;
+    }
+
+    const CarveKernels& kernels = carveKernels();
+    Mat output(image.rows, image.cols - (int)seams.size(), image.type());
+    for (int i = 0; i < image.rows; i++)
+        kernels.compactRow(image.ptr<uchar>(i), marked.ptr<uchar>(i), output.ptr<uchar>(i), image.cols, image.elemSize());
+
+    image = output;
+}
+
+// Function to find the cheapest vertical seam within a corridor of the given radius around a guide seam
+vector<int> findVerticalSeamInCorridor(const Mat& energy_map, const vector<int>& guide, int radius) {
+    int rows = energy_map.rows;
+    int cols = energy_map.cols;
+    int span = 2 * radius + 1;
+
+    // Cumulative energy of the corridor; entry k of row i is column lo[i] + k
+    vector<int> lo(rows), hi(rows);
+    vector<int> M((size_t)rows * span, numeric_limits<int>::max());
+    for (int i = 0; i < rows; i++) {
+        lo[i] = max(0, guide[i] - radius);
+        hi[i] = min(cols - 1, guide[i] + radius);
+        const uchar* energy = energy_map.ptr<uchar>(i);
+        int* row = &M[(size_t)i * span];
+
+        for (int x = lo[i]; x <= hi[i]; x++) {
+            if (i == 0) {
+                row[x - lo[i]] = energy[x];
+                continue;
+            }
+
+            // Cheapest neighbour above that lies inside the previous corridor row
+            const int* above = row - span;
+            int min_energy = numeric_limits<int>::max();
+            for (int px = max(x - 1, lo[i - 1]); px <= min(x + 1, hi[i - 1]); px++)
+                min_energy = min(min_energy, above[px - lo[i - 1]]);
+            if (min_energy != numeric_limits<int>::max())
+                row[x - lo[i]] = energy[x] + min_energy;
+        }
+    }
+
+    // Backtrack from the cheapest end point of the corridor
+    vector<int> seam(rows);
+    const int* last_row = &M[(size_t)(rows - 1) * span];
+    seam[rows - 1] = lo[rows - 1] + (int)(min_element(last_row, last_row + hi[rows - 1] - lo[rows - 1] + 1) - last_row);
+    for (int i = rows - 2; i >= 0; i--) {
+        const int* row = &M[(size_t)i * span];
+        int min_idx = -1;
+        for (int px = max(seam[i + 1] - 1, lo[i]); px <= min(seam[i + 1] + 1, hi[i]); px++) {
+            if (min_idx < 0 || row[px - lo[i]] < row[min_idx - lo[i]] || (px == seam[i + 1] && row[px - lo[i]] == row[min_idx - lo[i]]))
+                min_idx = px;
+        }
+        seam[i] = min_idx;
+    }
+
+    return seam;
+}
+
+// Function to find and remove a vertical seam with pyramid-refined dynamic programming
+// The seam is found on the image reduced by pyrDown, scaled back up and refined by a DP restricted
+// to a narrow corridor around it at full resolution
+void removeVerticalSeamPyramidDP(Mat& image) {
+    Mat energy_map = computeEnergyMap(image);
+    if (image.cols < 16 || image.rows < 16) {
+        removeVerticalSeam(image, findVerticalSeamDP(energy_map));
+        return;
+    }
+
+    Mat coarse;
+    pyrDown(image, coarse);
+    vector<int> coarse_seam = findVerticalSeamDP(computeEnergyMap(coarse));
+
+    // Every coarse row covers two full resolution rows and columns
+    vector<int> guide(image.rows);
+    for (int i = 0; i < image.rows; i++)
+        guide[i] = min(image.cols - 1, 2 * coarse_seam[min(i / 2, coarse.rows - 1)]);
+
+    removeVerticalSeam(image, findVerticalSeamInCorridor(energy_map, guide, 2));
+}
+
+// Function to remove vertical seams in batches found from one dynamic programming pass each
+// Every batch removes up to an eighth of the current width
+void removeVerticalSeamsBatched(Mat& image, int num_seams) {
+    while (num_seams > 0) {
+        int batch = min(num_seams, max(1, image.cols / 8));
+        vector<vector<int>> seams = findVerticalSeamsDP(computeEnergyMap(image), batch);
+        removeVerticalSeams(image, seams);
+        num_seams -= (int)seams.size();
+    }
+}
+
+// Execution strategies the planner chooses from, best quality first
+enum CarveStrategy {
+    STRATEGY_DP,            // Exact dynamic programming, one seam at a time
+    STRATEGY_PYRAMID_DP,    // DP on a pyrDown level refined in a corridor at full resolution
+    STRATEGY_BATCHED_DP,    // Several disjoint seams per DP pass
+    STRATEGY_SCALE_CARVE,   // Uniform INTER_AREA downscale for part of the reduction, DP for the rest
+    STRATEGY_GREEDY,        // Greedy seams
+    STRATEGY_COUNT
+};
+
+const char* const STRATEGY_NAMES[STRATEGY_COUNT] = { "dp", "pyramid-dp", "batched-dp", "scale+carve", "greedy" };
+
+// Linear cost model of the strategies: milliseconds per unit of work
+// A unit of work is one pixel of the image a seam is searched in; the resize term is per source pixel
+struct CostModel {
+    double ms_per_work[STRATEGY_COUNT] = { 4e-6, 2.5e-6, 4e-6, 4e-6, 1.5e-6 };
+    double ms_per_resized_pixel = 2e-6;
+
+    // FileStorage keys only allow letters, digits and underscores
+    static string key(int strategy) {
+        string name = string("ms_per_work_") + STRATEGY_NAMES[strategy];
+        replace_if(name.begin(), name.end(), [](char c) { return !isalnum((unsigned char)c); }, '_');
+        return name;
+    }
+
+    bool load(const string& path) {
+        FileStorage fs(path, FileStorage::READ);
+        if (!fs.isOpened())
+            return false;
+        for (int s = 0; s < STRATEGY_COUNT; s++)
+            if (!fs[key(s)].empty())
+                fs[key(s)] >> ms_per_work[s];
+        if (!fs["ms_per_resized_pixel"].empty())
+            fs["ms_per_resized_pixel"] >> ms_per_resized_pixel;
+        return true;
+    }
+
+    bool save(const string& path) const {
+        FileStorage fs(path, FileStorage::WRITE);
+        if (!fs.isOpened())
+            return false;
+        for (int s = 0; s < STRATEGY_COUNT; s++)
+            fs << key(s) << ms_per_work[s];
+        fs << "ms_per_resized_pixel" << ms_per_resized_pixel;
+        return true;
+    }
+};
+
+// Function to count the work of carving one seam at a time from one size to a smaller one
+// Vertical seams are searched in images from the source width down; horizontal ones at the target width
+double carveWork(Size from, Size to) {
+    double vertical = (double)from.height * (from.width + to.width + 1) * (from.width - to.width) / 2.0;
+    double horizontal = (double)to.width * (from.height + to.height + 1) * (from.height - to.height) / 2.0;
+    return vertical + horizontal;
+}
+
+// Function to count the work of the batched strategy, where each batch costs one search
+double batchedCarveWork(Size from, Size to) {
+    double work = 0;
+    for (int w = from.width; w > to.width; w -= min(w - to.width, max(1, w / 8)))
+        work += (double)w * from.height;
+    for (int h = from.height; h > to.height; h -= min(h - to.height, max(1, h / 8)))
+        work += (double)h * to.width;
+    return work;
+}
+
+// A strategy picked by the planner with its predicted time
+struct CarvePlan {
+    CarveStrategy strategy = STRATEGY_DP;
+    double scale_fraction = 0;  // Share of the reduction done by uniform scaling, for STRATEGY_SCALE_CARVE
+    double predicted_ms = 0;
+};
+
+// Function to get the size after uniformly scaling away a fraction of the reduction
+Size scaledSize(Size from, Size to, double scale_fraction) {
+    return Size(from.width - (int)((from.width - to.width) * scale_fraction),
+                from.height - (int)((from.height - to.height) * scale_fraction));
+}
+
+// Function to predict the time of a strategy with the cost model
+double predictCarveMs(const CostModel& model, CarveStrategy strategy, Size from, Size to, double scale_fraction = 0) {
+    switch (strategy) {
+    case STRATEGY_BATCHED_DP:
+        return model.ms_per_work[strategy] * batchedCarveWork(from, to);
+    case STRATEGY_SCALE_CARVE:
+        return model.ms_per_resized_pixel * from.area()
+            + model.ms_per_work[strategy] * carveWork(scaledSize(from, to, scale_fraction), to);
+    default:
+        return model.ms_per_work[strategy] * carveWork(from, to);
+    }
+}
+
+// Function to choose the best quality strategy predicted to finish within the time budget
+// Strategies are tried in quality order; scale+carve is tried with half of the reduction scaled.
+// When nothing fits, scale+carve takes the smallest scaled share that fits, up to a plain resize.
+CarvePlan planCarve(const CostModel& model, Size from, Size to, double budget_ms) {
+    CarvePlan plan;
+    for (int s = 0; s < STRATEGY_COUNT; s++) {
+        plan.strategy = (CarveStrategy)s;
+        plan.scale_fraction = plan.strategy == STRATEGY_SCALE_CARVE ? 0.5 : 0;
+        plan.predicted_ms = predictCarveMs(model, plan.strategy, from, to, plan.scale_fraction);
+        if (plan.predicted_ms <= budget_ms)
+            return plan;
+    }
+
+    plan.strategy = STRATEGY_SCALE_CARVE;
+    for (int step = 5; step <= 10; step++) {
+        plan.scale_fraction = step / 10.0;
+        plan.predicted_ms = predictCarveMs(model, plan.strategy, from, to, plan.scale_fraction);
+        if (plan.predicted_ms <= budget_ms)
+            break;
+    }
+    return plan;
+}
+
+// Function to uniformly downscale part of the reduction and carve the rest with dynamic programming
+Mat scaleThenCarve(const Mat& image, int new_width, int new_height, double scale_fraction) {
+    Size scaled = scaledSize(image.size(), Size(new_width, new_height), scale_fraction);
+    Mat result;
+    if (scaled == image.size())
+        result = image.clone();
+    else
+        resize(image, result, scaled, 0, 0, INTER_AREA);
+
+    for (int i = result.cols; i > new_width; i--) {
+        removeVerticalSeamDP(result);
+    }
+    removeHorizontalSeams(result, result.rows - new_height, removeVerticalSeamDP);
+    return result;
+}
+
+// Function to carve an image to a smaller size with the strategy of a plan
+Mat executeCarvePlan(const Mat& image, int new_width, int new_height, const CarvePlan& plan) {
+    Mat result = image.clone();
+    int num_vertical_seams = image.cols - new_width;
+    int num_horizontal_seams = image.rows - new_height;
+    Mat transposed_image;
+
+    switch (plan.strategy) {
+    case STRATEGY_DP:
+        for (int i = 0; i < num_vertical_seams; i++)
+            removeVerticalSeamDP(result);
+        removeHorizontalSeams(result, num_horizontal_seams, removeVerticalSeamDP);
+        break;
+    case STRATEGY_PYRAMID_DP:
+        for (int i = 0; i < num_vertical_seams; i++)
+            removeVerticalSeamPyramidDP(result);
+        transpose(result, transposed_image);
+        for (int i = 0; i < num_horizontal_seams; i++)
+            removeVerticalSeamPyramidDP(transposed_image);
+        transpose(transposed_image, result);
+        break;
+    case STRATEGY_BATCHED_DP:
+        removeVerticalSeamsBatched(result, num_vertical_seams);
+        transpose(result, transposed_image);
+        removeVerticalSeamsBatched(transposed_image, num_horizontal_seams);
+        transpose(transposed_image, result);
+        break;
+    case STRATEGY_SCALE_CARVE:
+        result = scaleThenCarve(image, new_width, new_height, plan.scale_fraction);
+        break;
+    default:
+        for (int i = 0; i < num_vertical_seams; i++)
+            removeVerticalSeamGreedy(result);
+        removeHorizontalSeams(result, num_horizontal_seams, removeVerticalSeamGreedy);
+        break;
+    }
+
+    return result;
+}
+
+// Function to carve within a time budget, logging the chosen strategy and the prediction error
+Mat carveWithinBudget(const CostModel& model, const Mat& image, int new_width, int new_height, double budget_ms) {
+    CarvePlan plan = planCarve(model, image.size(), Size(new_width, new_height), budget_ms);
+
+    int64 start = getTickCount();
+    Mat result = executeCarvePlan(image, new_width, new_height, plan);
+    double actual_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    cout << "Planner: " << STRATEGY_NAMES[plan.strategy];
+    if (plan.strategy == STRATEGY_SCALE_CARVE)
+        cout << " (" << cvRound(plan.scale_fraction * 100) << "% scaled)";
+    cout << ", predicted " << plan.predicted_ms << " ms, actual " << actual_ms << " ms, error "
+        << (plan.predicted_ms > 0 ? (actual_ms - plan.predicted_ms) * 100.0 / plan.predicted_ms : 0) << "%" << endl;
+    return result;
+}
+
+// Result of carving against a deadline
+struct AnytimeResult {
+    Mat image;
+    int carved_seams = 0;   // Seams removed by carving before the deadline
+    int scaled_seams = 0;   // Seams left at the deadline and replaced by a uniform resize
+};
+
+// Function to carve an image to a smaller size, falling back to a uniform resize when the deadline expires
+// The deadline is checked once per seam, a single tick counter read next to a full energy and DP pass
+AnytimeResult carveWithDeadline(const Mat& image, int new_width, int new_height, double deadline_ms,
+                                void (*remove_vertical_seam)(Mat&) = removeVerticalSeamDP) {
+    AnytimeResult result;
+    int64 deadline = getTickCount() + (int64)(deadline_ms * getTickFrequency() / 1000.0);
+    auto before_deadline = [deadline]() { return getTickCount() < deadline; };
+
+    // Vertical seams first, then horizontal seams on the transposed image
+    result.image = image.clone();
+    result.carved_seams = removeVerticalSeamsWhile(result.image, image.cols - new_width, before_deadline, remove_vertical_seam);
+    if (result.image.cols == new_width)
+        result.carved_seams += removeHorizontalSeamsWhile(result.image, image.rows - new_height, before_deadline, remove_vertical_seam);
+
+    // Scale away whatever the deadline left
+    result.scaled_seams = (result.image.cols - new_width) + (result.image.rows - new_height);
+    if (result.scaled_seams > 0)
+        resize(result.image, result.image, Size(new_width, new_height), 0, 0, INTER_AREA);
+
+    return result;
+}
+
+// Phases of a carving job, as reported by CarveProgress
+enum CarvePhase {
+    CARVE_PHASE_IDLE,
+    CARVE_PHASE_VERTICAL,
+    CARVE_PHASE_HORIZONTAL,
+    CARVE_PHASE_DONE,
+    CARVE_PHASE_CANCELLED
+};
+
+const char* const CARVE_PHASE_NAMES[] = { "idle", "vertical seams", "horizontal seams", "done", "cancelled" };
+
+// Progress of a carving job, written by the carving thread and polled by any other thread without locks
+struct CarveProgress {
+    atomic<int> seams_done{ 0 };
+    atomic<int> seams_total{ 0 };
+    atomic<int> phase{ CARVE_PHASE_IDLE };
+    CancellationToken cancel;
+};
+
+// Function to remove vertical seams with dynamic programming until done or cancelled
+// Returns false when cancelled; the seams removed so far stay removed
+bool removeVerticalSeamsDP(Mat& image, int num_seams, CarveProgress& progress) {
+    for (int k = 0; k < num_seams; k++) {
+        if (progress.cancel.isCancelled())
+            return false;
+        vector<int> seam = findVerticalSeamDP(computeEnergyMap(image), nullptr, Mat(), &progress.cancel);
+        if (seam.empty())
+            return false;
+        removeVerticalSeam(image, seam);
+        progress.seams_done.fetch_add(1, memory_order_relaxed);
+    }
+    return true;
+}
+
+// Function to carve an image to a smaller size with dynamic programming, reporting progress as it goes
+// Cancellation is checked between seams and between row bands of the dynamic programming pass, so a
+// cancelled job stops within a fraction of a seam. Returns false when cancelled; image then holds the
+// partial result and every temporary of the job has been released.
+bool carveWithProgress(Mat& image, int new_width, int new_height, CarveProgress& progress) {
+    progress.seams_done.store(0, memory_order_relaxed);
+    progress.seams_total.store((image.cols - new_width) + (image.rows - new_height), memory_order_relaxed);
+
+    progress.phase.store(CARVE_PHASE_VERTICAL, memory_order_relaxed);
+    bool completed = removeVerticalSeamsDP(image, image.cols - new_width, progress);
+
+    if (completed) {
+        progress.phase.store(CARVE_PHASE_HORIZONTAL, memory_order_relaxed);
+        Mat transposed_image;
+        transpose(image, transposed_image);
+        completed = removeVerticalSeamsDP(transposed_image, image.rows - new_height, progress);
+        transpose(transposed_image, image);
+    }
+
+    progress.phase.store(completed ? CARVE_PHASE_DONE : CARVE_PHASE_CANCELLED, memory_order_release);
+    return completed;
+}
+
+// Function to calibrate the cost model on this machine by timing every strategy on an image
+// Each strategy carves a tenth of the width and height; the coefficients are the measured time over the work
+CostModel calibrateCostModel(const Mat& image) {
+    CostModel model;
+    Size from = image.size();
+    Size to(max(1, from.width - max(1, from.width / 10)), max(1, from.height - max(1, from.height / 10)));
+
+    for (int s = 0; s < STRATEGY_COUNT; s++) {
+        CarvePlan plan;
+        plan.strategy = (CarveStrategy)s;
+        plan.scale_fraction = plan.strategy == STRATEGY_SCALE_CARVE ? 0.5 : 0;
+
+        int64 start = getTickCount();
+        executeCarvePlan(image, to.width, to.height, plan);
+        double ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+        if (plan.strategy == STRATEGY_SCALE_CARVE) {
+            // Split the measured time between the resize and the carve using a separate resize timing
+            Mat resized;
+            start = getTickCount();
+            resize(image, resized, scaledSize(from, to, plan.scale_fraction), 0, 0, INTER_AREA);
+            model.ms_per_resized_pixel = (getTickCount() - start) * 1000.0 / getTickFrequency() / from.area();
+            ms = max(0.0, ms - model.ms_per_resized_pixel * from.area());
+            model.ms_per_work[s] = ms / carveWork(scaledSize(from, to, plan.scale_fraction), to);
+        }
+        else {
+            model.ms_per_work[s] = ms / (plan.strategy == STRATEGY_BATCHED_DP ? batchedCarveWork(from, to) : carveWork(from, to));
+        }
+        cout << "  " << STRATEGY_NAMES[s] << ": " << ms << " ms" << endl;
+    }
+
+    return model;
+}
+
+// Function to measure how much of the image content a reduction kept
+// Ratio of the mean energy of the result to that of the source: carving removes low energy pixels first,
+// so content-aware results stay at or above 1 while uniform scaling smooths the image and drops below it
+double energyPreservation(const Mat& source, const Mat& result) {
+    double source_mean = mean(computeEnergyMap(source))[0];
+    return source_mean > 0 ? mean(computeEnergyMap(result))[0] / source_mean : 1.0;
+}
+
+// Function to pick the share of a reduction to scale uniformly before carving
+// The time target sets the smallest share the cost model allows; above it, the largest share whose
+// energy preservation on a quarter-resolution preview still meets the quality target is taken.
+// A budget of 0 means no time limit; the time target wins when both cannot be met.
+double chooseScaleFraction(const CostModel& model, const Mat& image, Size target, double budget_ms, double min_preservation) {
+    const int steps = 4;
+
+    double min_fraction = 1.0;
+    for (int step = 0; step <= steps; step++) {
+        double fraction = (double)step / steps;
+        if (budget_ms <= 0 || predictCarveMs(model, STRATEGY_SCALE_CARVE, image.size(), target, fraction) <= budget_ms) {
+            min_fraction = fraction;
+            break;
+        }
+    }
+
+    // Judge the quality of each share on a preview of the image and the target at quarter resolution
+    Mat preview;
+    resize(image, preview, Size(), 0.25, 0.25, INTER_AREA);
+    Size preview_target(max(1, cvRound(target.width * preview.cols / (double)image.cols)),
+                        max(1, cvRound(target.height * preview.rows / (double)image.rows)));
+
+    double fraction = min_fraction;
+    for (int step = steps; step >= 0 && (double)step / steps > min_fraction; step--) {
+        double candidate = (double)step / steps;
+        Mat reduced = scaleThenCarve(preview, preview_target.width, preview_target.height, candidate);
+        if (energyPreservation(preview, reduced) >= min_preservation) {
+            fraction = candidate;
+            break;
+        }
+    }
+    return fraction;
+}
+
+// Function to run the hybrid scale-then-carve mode and report its speedup and energy preservation
+// The speedup is against carving every seam with dynamic programming as predicted by the cost model
+Mat hybridScaleCarve(const CostModel& model, const Mat& image, int new_width, int new_height, double scale_fraction) {
+    Size target(new_width, new_height);
+
+    int64 start = getTickCount();
+    Mat result = scaleThenCarve(image, new_width, new_height, scale_fraction);
+    double elapsed_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    double full_dp_ms = predictCarveMs(model, STRATEGY_DP, image.size(), target);
+    cout << "Hybrid: " << cvRound(scale_fraction * 100) << "% of the reduction scaled, " << elapsed_ms << " ms, "
+        << "speedup " << (elapsed_ms > 0 ? full_dp_ms / elapsed_ms : 0) << "x over full DP (predicted " << full_dp_ms << " ms), "
+        << "energy preservation " << energyPreservation(image, result) << endl;
+    return result;
+}
+
+// Function to remove vertical seams starting from a precomputed energy map of the image
+// The first seam is found in the given energy map, every later one in a freshly computed map
+void carveVerticalSeams(Mat& image, int num_seams, const Mat& initial_energy, vector<int> (*find_seam)(const Mat&)) {
+    for (int i = 0; i < num_seams; i++)
+        removeVerticalSeam(image, find_seam(i == 0 ? initial_energy : computeEnergyMap(image)));
+}
+
+// A carving algorithm compared side by side with others on the same image
+struct CarveVariant {
+    typedef function<Mat(const Mat& image, const Mat& initial_energy)> CarveFunction;
+
+    CarveVariant(const string& name, const string& output_file, CarveFunction carve)
+        : name(name), output_file(output_file), carve(carve) {}
+
+    string name;
+    string output_file;
+    CarveFunction carve;
+    Mat result;
+    double elapsed_ms = 0;
+};
+
+// Function to run carving variants concurrently on one image
+// The energy map of the image is computed once and shared read-only; each result is written as soon as its
+// variant finishes, so a slow variant does not hold back the output of the others
+void runCarveVariants(const Mat& image, vector<CarveVariant>& variants) {
+    int64 start = getTickCount();
+    Mat initial_energy = computeEnergyMap(image);
+
+    mutex log_mutex;
+    vector<thread> workers;
+    for (CarveVariant& variant : variants) {
+        workers.emplace_back([&image, &initial_energy, &variant, &log_mutex]() {
+            int64 variant_start = getTickCount();
+            variant.result = variant.carve(image, initial_energy);
+            variant.elapsed_ms = (getTickCount() - variant_start) * 1000.0 / getTickFrequency();
+            imwrite(variant.output_file, variant.result);
+
+            lock_guard<mutex> lock(log_mutex);
+            cout << variant.name << ": " << variant.elapsed_ms << " ms" << endl;
+        });
+    }
+    for (thread& worker : workers)
+        worker.join();
+
+    cout << variants.size() << " variants carved in "
+        << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+}
+
+// Bounded multi-producer multi-consumer queue without locks (Vyukov)
+// Every cell carries a sequence number telling producers and consumers whose turn it is, so a push or
+// pop is one compare-and-swap on the shared position; the capacity is rounded up to a power of two
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t min_capacity) {
+        size_t capacity = 2;
+        while (capacity < min_capacity)
+            capacity *= 2;
+        mask = capacity - 1;
+        cells.reset(new Cell[capacity]);
+        for (size_t k = 0; k < capacity; k++)
+            cells[k].sequence.store(k, memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Approximate number of queued items, for reporting
+    size_t size() const {
+        size_t enqueued = enqueue_pos.load(memory_order_relaxed);
+        size_t dequeued = dequeue_pos.load(memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    // Function to append an item, failing when the queue is full
+    bool tryPush(T& value) {
+        size_t pos = enqueue_pos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            intptr_t diff = (intptr_t)cell.sequence.load(memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = move(value);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+
+    // Function to take the oldest item, failing when the queue is empty
+    bool tryPop(T& value) {
+        size_t pos = dequeue_pos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            intptr_t diff = (intptr_t)cell.sequence.load(memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = move(cell.value);
+                    cell.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeue_pos.load(memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // Producers and consumers each get their own cache line
+    alignas(64) atomic<size_t> enqueue_pos{ 0 };
+    alignas(64) atomic<size_t> dequeue_pos{ 0 };
+};
+
+// Status and timing of one image of a batch
+struct BatchResult {
+    string path;
+    string status = "ok";
+    double load_ms = 0;
+    double carve_ms = 0;
+    double save_ms = 0;
+    vector<string> outputs;
+};
+
+// An image travelling through the batch pipeline; images holds the decoded image, then the carved results
+struct BatchItem {
+    size_t index = 0;
+    vector<Mat> images;
+};
+
+// Timing of one pipeline stage and the depth of the queue it feeds
+struct BatchStageStats {
+    const char* name;
+    int threads;
+    atomic<int64> busy_ticks{ 0 };
+    atomic<int64> depth_sum{ 0 };
+    atomic<int64> depth_samples{ 0 };
+    atomic<size_t> max_depth{ 0 };
+
+    BatchStageStats(const char* name, int threads) : name(name), threads(threads) {}
+
+    void addBusy(int64 start) { busy_ticks += getTickCount() - start; }
+
+    // Function to record the depth of the output queue right after a push
+    void sampleDepth(size_t depth) {
+        depth_sum += (int64)depth;
+        depth_samples++;
+        size_t current = max_depth.load();
+        while (depth > current && !max_depth.compare_exchange_weak(current, depth)) {}
+    }
+};
+
+// Function to back off while waiting on a bounded queue
+// A stage behind a slow one can wait for seconds, so after a short spin it sleeps instead of keeping a core busy
+void queueBackoff(int spins) {
+    if (spins < 64)
+        this_thread::yield();
+    else
+        this_thread::sleep_for(chrono::microseconds(200));
+}
+
+// Function to push into a bounded queue, waiting while it is full; the wait is the back-pressure
+// that stops a fast stage from running ahead of a slow one
+template <typename T>
+void pushWaiting(BoundedQueue<T>& queue, T& item) {
+    for (int spins = 0; !queue.tryPush(item); spins++)
+        queueBackoff(spins);
+}
+
+// Function to pop from a bounded queue, waiting while it is empty
+// Returns false once the queue is empty and every producer of it has finished
+template <typename T>
+bool popWaiting(BoundedQueue<T>& queue, T& item, const atomic<int>& producers_left) {
+    for (int spins = 0; !queue.tryPop(item); spins++) {
+        if (producers_left.load() == 0)
+            return queue.tryPop(item);
+        queueBackoff(spins);
+    }
+    return true;
+}
+
+// Function to list the images of a batch from a directory or from a manifest with one path per line
+// Relative manifest entries are resolved against the directory of the manifest
+vector<filesystem::path> listBatchImages(const string& source) {
+    vector<filesystem::path> images;
+    filesystem::path source_path(source);
+
+    if (filesystem::is_directory(source_path)) {
+        const vector<string> extensions = { ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp" };
+        for (const filesystem::directory_entry& entry : filesystem::directory_iterator(source_path)) {
+            string extension = entry.path().extension().string();
+            transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+            if (entry.is_regular_file() && find(extensions.begin(), extensions.end(), extension) != extensions.end())
+                images.push_back(entry.path());
+        }
+        sort(images.begin(), images.end());
+        return images;
+    }
+
+    ifstream manifest(source);
+    string line;
+    while (getline(manifest, line)) {
+        // Skip blank lines and comments
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        filesystem::path image_path(line);
+        images.push_back(image_path.is_relative() ? source_path.parent_path() / image_path : image_path);
+    }
+    return images;
+}
+
+// Function to carve one decoded image of a batch to every target size with dynamic programming
+vector<Mat> carveBatchImage(const Mat& image, const vector<Size>& targets) {
+    // Carve the reductions in one pass, then enlarge where a target exceeds the image
+    vector<Size> reduced_targets;
+    for (const Size& target : targets)
+        reduced_targets.push_back(Size(min(target.width, image.cols), min(target.height, image.rows)));
+    vector<Mat> results = carveToSizes(image, reduced_targets, removeVerticalSeamDP);
+
+    for (size_t k = 0; k < targets.size(); k++) {
+        insertVerticalSeams(results[k], targets[k].width - image.cols);
+        insertHorizontalSeams(results[k], targets[k].height - image.rows);
+    }
+    return results;
+}
+
+// Function to carve a directory or manifest of images to the target sizes and write a results manifest
+// Decode threads, carve workers and encode threads are connected by bounded queues, so PNG decoding and
+// encoding overlap with carving and at most the queue capacities plus one image per thread are in memory.
+// Carve workers pull from a shared queue, so a slow image never holds up the others. The cores not taken
+// by the stage threads go to the parallel_for_ inside each image.
+void carveBatch(const string& source, const vector<Size>& targets, const string& output_dir) {
+    vector<filesystem::path> images = listBatchImages(source);
+    if (images.empty()) {
+        cout << "No images found in " << source << endl;
+        return;
+    }
+    filesystem::create_directories(output_dir);
+
+    // Decoding and encoding take a fraction of the time of carving; they get an eighth of the cores each
+    int num_cpus = max(1, getNumberOfCPUs());
+    int num_decoders = max(1, num_cpus / 8);
+    int num_encoders = max(1, num_cpus / 8);
+    int carve_cpus = max(1, num_cpus - num_decoders - num_encoders);
+    int num_carvers = min(carve_cpus, (int)images.size());
+    int previous_num_threads = getNumThreads();
+    setNumThreads(max(1, carve_cpus / num_carvers));
+    cout << "Carving " << images.size() << " images with " << num_decoders << " decoders, " << num_carvers
+        << " carve workers of " << getNumThreads() << " threads and " << num_encoders << " encoders" << endl;
+
+    BoundedQueue<BatchItem> decoded(2 * num_carvers), carved(2 * num_carvers);
+    BatchStageStats decode_stats("decode", num_decoders), carve_stats("carve", num_carvers), encode_stats("encode", num_encoders);
+    atomic<size_t> next_image{ 0 };
+    atomic<int> decoders_left{ num_decoders }, carvers_left{ num_carvers };
+    vector<BatchResult> results(images.size());
+    vector<thread> threads;
+
+    int64 start = getTickCount();
+    for (int t = 0; t < num_decoders; t++) {
+        threads.emplace_back([&]() {
+            for (size_t k; (k = next_image++) < images.size();) {
+                BatchResult& result = results[k];
+                result.path = images[k].string();
+
+                int64 stage_start = getTickCount();
+                BatchItem item;
+                item.index = k;
+                item.images.push_back(imread(result.path, IMREAD_UNCHANGED));
+                decode_stats.addBusy(stage_start);
+                result.load_ms = (getTickCount() - stage_start) * 1000.0 / getTickFrequency();
+
+                if (item.images[0].empty()) {
+                    result.status = "unreadable";
+                    continue;
+                }
+                pushWaiting(decoded, item);
+                decode_stats.sampleDepth(decoded.size());
+            }
+            decoders_left--;
+        });
+    }
+
+    for (int t = 0; t < num_carvers; t++) {
+        threads.emplace_back([&]() {
+            BatchItem item;
+            while (popWaiting(decoded, item, decoders_left)) {
+                BatchResult& result = results[item.index];
+
+                int64 stage_start = getTickCount();
+                try {
+                    item.images = carveBatchImage(item.images[0], targets);
+                }
+                catch (const Exception& e) {
+                    result.status = string("error: ") + e.what();
+                    item.images.clear();
+                }
+                carve_stats.addBusy(stage_start);
+                result.carve_ms = (getTickCount() - stage_start) * 1000.0 / getTickFrequency();
+
+                if (item.images.empty())
+                    continue;
+                pushWaiting(carved, item);
+                carve_stats.sampleDepth(carved.size());
+            }
+            carvers_left--;
+        });
+    }
+
+    for (int t = 0; t < num_encoders; t++) {
+        threads.emplace_back([&]() {
+            BatchItem item;
+            while (popWaiting(carved, item, carvers_left)) {
+                BatchResult& result = results[item.index];
+                filesystem::path image_path = images[item.index];
+
+                int64 stage_start = getTickCount();
+                for (size_t k = 0; k < targets.size(); k++) {
+                    stringstream ss_filename;
+                    ss_filename << image_path.stem().string() << "_" << targets[k].width << "x" << targets[k].height << ".png";
+                    filesystem::path output_path = filesystem::path(output_dir) / ss_filename.str();
+                    try {
+                        if (!imwrite(output_path.string(), item.images[k]))
+                            result.status = "write failed";
+                    }
+                    catch (const Exception& e) {
+                        result.status = string("error: ") + e.what();
+                    }
+                    result.outputs.push_back(output_path.string());
+                }
+                item.images.clear();
+                encode_stats.addBusy(stage_start);
+                result.save_ms = (getTickCount() - stage_start) * 1000.0 / getTickFrequency();
+            }
+        });
+    }
+
+    for (thread& worker : threads)
+        worker.join();
+    double elapsed_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    setNumThreads(previous_num_threads);
+
+    // One line per image with its status, timings and outputs
+    filesystem::path manifest_path = filesystem::path(output_dir) / "results.csv";
+    ofstream manifest(manifest_path);
+    manifest << "path,status,load_ms,carve_ms,save_ms,outputs" << endl;
+    int failures = 0;
+    for (const BatchResult& result : results) {
+        manifest << "\"" << result.path << "\",\"" << result.status << "\"," << result.load_ms << "," << result.carve_ms
+            << "," << result.save_ms << ",\"";
+        for (size_t k = 0; k < result.outputs.size(); k++)
+            manifest << (k ? ";" : "") << result.outputs[k];
+        manifest << "\"" << endl;
+        failures += result.status != "ok";
+    }
+
+    cout << images.size() - failures << " of " << images.size() << " images carved in " << elapsed_ms << " ms, results in "
+        << manifest_path.string() << endl;
+
+    // Utilization is the share of the wall time the threads of a stage spent working rather than waiting;
+    // a full output queue means the next stage is the bottleneck
+    const BatchStageStats* stages[] = { &decode_stats, &carve_stats, &encode_stats };
+    const BoundedQueue<BatchItem>* output_queues[] = { &decoded, &carved, nullptr };
+    for (int s = 0; s < 3; s++) {
+        const BatchStageStats& stats = *stages[s];
+        double busy_ms = stats.busy_ticks * 1000.0 / getTickFrequency();
+        cout << "  " << stats.name << ": " << stats.threads << " threads, "
+            << (elapsed_ms > 0 ? busy_ms * 100.0 / (elapsed_ms * stats.threads) : 0) << "% utilized";
+        if (output_queues[s]) {
+            cout << ", output queue depth mean "
+                << (stats.depth_samples ? (double)stats.depth_sum / stats.depth_samples : 0)
+                << " max " << stats.max_depth << " of " << output_queues[s]->capacity();
+        }
+        cout << endl;
+    }
+}
+
+// Function to split vertical seams between slabs in proportion to their low-energy mass
+// The low-energy mass of a slab is the sum of 255 minus the energy of its pixels. A slab keeps at least one
+// column; seams a full slab cannot take go to the slabs with the largest unmet share.
+vector<int> allocateSlabSeams(const Mat& energy_map, const vector<int>& bounds, int num_seams) {
+    int num_slabs = (int)bounds.size() - 1;
+    vector<double> mass(num_slabs);
+    double total_mass = 0;
+    for (int s = 0; s < num_slabs; s++) {
+        Mat slab_energy = energy_map.colRange(bounds[s], bounds[s + 1]);
+        mass[s] = 255.0 * slab_energy.total() - sum(slab_energy)[0];
+        total_mass += mass[s];
+    }
+
+    // Fully saturated energy everywhere: split by width
+    if (total_mass <= 0) {
+        for (int s = 0; s < num_slabs; s++)
+            mass[s] = bounds[s + 1] - bounds[s];
+        total_mass = bounds[num_slabs];
+    }
+
+    vector<int> seams(num_slabs);
+    vector<double> share(num_slabs);
+    int allocated = 0;
+    for (int s = 0; s < num_slabs; s++) {
+        share[s] = num_seams * mass[s] / total_mass;
+        seams[s] = min((int)share[s], bounds[s + 1] - bounds[s] - 1);
+        allocated += seams[s];
+    }
+
+    while (allocated < num_seams) {
+        int best = -1;
+        for (int s = 0; s < num_slabs; s++) {
+            if (seams[s] < bounds[s + 1] - bounds[s] - 1 && (best < 0 || share[s] - seams[s] > share[best] - seams[best]))
+                best = s;
+        }
+        seams[best]++;
+        allocated++;
+    }
+    return seams;
+}
+
+// Function to remove vertical seams approximately by carving vertical slabs of the image independently
+// Each slab is carved on its own thread together with a margin of its neighbours' columns. The margin is
+// protected, so seams stay inside the slab while the energy at its borders still sees the neighbouring
+// content. No seam crosses a slab border, so once the margins are dropped the slabs stitch back seamlessly.
+// Throws when a slab cannot take its share of seams without cutting into its margins.
+Mat carveVerticalSlabs(const Mat& image, int num_seams, int num_slabs, int margin = 8) {
+    int cols = image.cols;
+    num_slabs = max(1, min(num_slabs, cols - num_seams));
+
+    vector<int> bounds(num_slabs + 1);
+    for (int s = 0; s <= num_slabs; s++)
+        bounds[s] = (int)((int64)s * cols / num_slabs);
+    vector<int> slab_seams = allocateSlabSeams(computeEnergyMap(image), bounds, num_seams);
+
+    vector<Mat> slabs(num_slabs);
+    vector<int> removed(num_slabs);
+    parallel_for_(Range(0, num_slabs), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            int lo = max(0, bounds[s] - margin);
+            int hi = min(cols, bounds[s + 1] + margin);
+            Mat slab = image.colRange(lo, hi).clone();
+
+            // Protect the margins borrowed from the neighbouring slabs
+            Mat protect_mask = Mat::zeros(slab.size(), CV_8U);
+            protect_mask.colRange(0, bounds[s] - lo).setTo(255);
+            protect_mask.colRange(bounds[s + 1] - lo, hi - lo).setTo(255);
+            removed[s] = removeVerticalSeamsProtected(slab, protect_mask, slab_seams[s]);
+
+            slabs[s] = slab.colRange(bounds[s] - lo, slab.cols - (hi - bounds[s + 1]));
+        }
+    }, num_slabs);
+
+    // A slab that stopped early would leave the result wider than asked
+    for (int s = 0; s < num_slabs; s++) {
+        if (removed[s] < slab_seams[s])
+            CV_Error(Error::StsError, format("slab %d removed only %d of its %d seams", s, removed[s], slab_seams[s]));
+    }
+
+    Mat result;
+    hconcat(slabs, result);
+    return result;
+}
+
+// Function to carve an image to a smaller size with slab-parallel approximate seams in both directions
+Mat carveSlabs(const Mat& image, int new_width, int new_height, int num_slabs) {
+    Mat result = carveVerticalSlabs(image, image.cols - new_width, num_slabs);
+
+    Mat transposed_image;
+    transpose(result, transposed_image);
+    transposed_image = carveVerticalSlabs(transposed_image, image.rows - new_height, num_slabs);
+    transpose(transposed_image, result);
+    return result;
+}
+
+// Time and quality of slab carving against global seams on one image
+struct SlabComparison {
+    double slab_ms = 0;
+    double global_ms = 0;
+    double slab_preservation = 0;
+    double global_preservation = 0;
+
+    double speedup() const { return slab_ms > 0 ? global_ms / slab_ms : 0; }
+
+    // Relative loss of energy preservation against global seams, in percent
+    double qualityLoss() const { return global_preservation > 0 ? (1 - slab_preservation / global_preservation) * 100 : 0; }
+};
+
+// Function to carve an image with slabs and with global dynamic programming seams and compare the two
+SlabComparison compareSlabCarve(const Mat& image, int new_width, int new_height, int num_slabs, Mat* slab_result = nullptr) {
+    SlabComparison comparison;
+
+    int64 start = getTickCount();
+    Mat result = carveSlabs(image, new_width, new_height, num_slabs);
+    comparison.slab_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    comparison.slab_preservation = energyPreservation(image, result);
+
+    start = getTickCount();
+    Mat global_result = executeCarvePlan(image, new_width, new_height, CarvePlan());
+    comparison.global_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    comparison.global_preservation = energyPreservation(image, global_result);
+
+    if (slab_result)
+        *slab_result = result;
+    return comparison;
+}
+
+// Function to print a slab comparison
+void printSlabComparison(const string& label, const SlabComparison& comparison) {
+    cout << label << ": slabs " << comparison.slab_ms << " ms, global " << comparison.global_ms << " ms, speedup "
+        << comparison.speedup() << "x, energy preservation " << comparison.slab_preservation << " vs "
+        << comparison.global_preservation << " (" << comparison.qualityLoss() << "% loss)" << endl;
+}
+
+// Function to precompute the seam index map of an image (Avidan and Shamir)
+// All vertical seams are removed with dynamic programming and every pixel records
+// the iteration at which it was removed; the last remaining column gets cols - 1
+Mat computeSeamIndexMap(const Mat& image) {
+    int rows = image.rows;
+    int cols = image.cols;
+
+    // Track the original column of every pixel while the image is carved
+    Mat carved = image.clone();
+    Mat columns(rows, cols, CV_32S);
+    for (int i = 0; i < rows; i++) {
+        int* column = columns.ptr<int>(i);
+        for (int j = 0; j < cols; j++)
+            column[j] = j;
+    }
+
+    // Every pixel survives until proven otherwise
+    Mat index_map(rows, cols, CV_32S, Scalar(cols - 1));
+
+    for (int k = 0; k < cols - 1; k++) {
+        // Find the seam exactly as removeVerticalSeamDP would
+        Mat energy_map = computeEnergyMap(carved);
+        vector<int> seam = findVerticalSeamDP(energy_map);
+
+        // Record the iteration for the original pixels on the seam
+        for (int i = 0; i < rows; i++)
+            index_map.at<int>(i, columns.at<int>(i, seam[i])) = k;
+
+        // Remove the seam from the image and the column map in lockstep
+        removeVerticalSeam(carved, seam);
+        removeVerticalSeam(columns, seam);
+    }
+
+    return index_map;
+}
+
+// Function to copy the pixels whose seam index is at least the threshold into the output
+template <typename T, int cn>
+void gatherSeamIndexPixels(const Mat& image, const Mat& index_map, int threshold, Mat& output) {
+    typedef typename SeamPixel<T, cn>::type Pixel;
+
+    for (int i = 0; i < image.rows; i++) {
+        const Pixel* src = image.ptr<Pixel>(i);
+        const int* index = index_map.ptr<int>(i);
+        Pixel* dst = output.ptr<Pixel>(i);
+
+        for (int j = 0; j < image.cols; j++) {
+            if (index[j] >= threshold)
+                *dst++ = src[j];
+        }
+    }
+}
+
+// Function to retarget an image to a smaller width with its precomputed seam index map
+// This is a single gather pass giving the same result as removing the seams one by one
+Mat retargetWidth(const Mat& image, const Mat& index_map, int new_width) {
+    CV_Assert(index_map.type() == CV_32S && index_map.size() == image.size());
+    CV_Assert(new_width > 0 && new_width <= image.cols);
+
+    // Pixels removed in the first cols - new_width iterations are dropped
+    int threshold = image.cols - new_width;
+    Mat output(image.rows, new_width, image.type());
+
+    // Dispatch to the specialization for the common pixel types
+    switch (image.type()) {
+    case CV_8UC1:  gatherSeamIndexPixels<uchar, 1>(image, index_map, threshold, output); break;
+    case CV_8UC3:  gatherSeamIndexPixels<uchar, 3>(image, index_map, threshold, output); break;
+    case CV_8UC4:  gatherSeamIndexPixels<uchar, 4>(image, index_map, threshold, output); break;
+    case CV_16UC1: gatherSeamIndexPixels<ushort, 1>(image, index_map, threshold, output); break;
+    case CV_16UC3: gatherSeamIndexPixels<ushort, 3>(image, index_map, threshold, output); break;
+    case CV_16UC4: gatherSeamIndexPixels<ushort, 4>(image, index_map, threshold, output); break;
+    case CV_32FC1: gatherSeamIndexPixels<float, 1>(image, index_map, threshold, output); break;
+    case CV_32FC3: gatherSeamIndexPixels<float, 3>(image, index_map, threshold, output); break;
+    case CV_32FC4: gatherSeamIndexPixels<float, 4>(image, index_map, threshold, output); break;
+    case CV_32SC1: gatherSeamIndexPixels<int, 1>(image, index_map, threshold, output); break;
+    default: {
+        // Fallback for pixel types without a specialization, copying raw bytes per pixel
+        size_t pixel_size = image.elemSize();
+        for (int i = 0; i < image.rows; i++) {
+            const uchar* src = image.ptr<uchar>(i);
+            const int* index = index_map.ptr<int>(i);
+            uchar* dst = output.ptr<uchar>(i);
+            for (int j = 0; j < image.cols; j++) {
+                if (index[j] >= threshold) {
+                    memcpy(dst, src + j * pixel_size, pixel_size);
+                    dst += pixel_size;
+                }
+            }
+        }
+        break;
+    }
+    }
+
+    return output;
+}
+
+// One width level of the two-dimensional retargeting maps
+// The level image is the source carved vertically to the level width; it is stored transposed
+// together with its horizontal seam index map so the height gather is a plain retargetWidth
+struct RetargetingLevel {
+    int width;
+    Mat image_t;             // Level image, transposed
+    Mat vertical_index_t;    // Vertical seam index of every level pixel in the source, transposed
+    Mat horizontal_index_t;  // Horizontal seam index map of the level image, transposed
+};
+
+// Precomputed maps answering any (width, height) request with gathers only
+struct RetargetingMaps {
+    Mat vertical_index_map;
+    vector<RetargetingLevel> levels;  // Sorted by decreasing width, the first level is the source width
+    double precompute_ms = 0;
+    size_t memory_bytes = 0;
+};
+
+// Function to precompute the retargeting maps of an image with the given number of width levels
+RetargetingMaps computeRetargetingMaps(const Mat& image, int num_levels) {
+    CV_Assert(num_levels > 0);
+    int64 start = getTickCount();
+
+    RetargetingMaps maps;
+    maps.vertical_index_map = computeSeamIndexMap(image);
+    maps.memory_bytes = maps.vertical_index_map.total() * maps.vertical_index_map.elemSize();
+
+    for (int k = 0; k < num_levels; k++) {
+        int width = max(1, image.cols * (num_levels - k) / num_levels);
+        if (!maps.levels.empty() && maps.levels.back().width == width)
+            continue;
+
+        // Carve the source to the level width and carry the vertical index of every kept pixel
+        RetargetingLevel level;
+        level.width = width;
+        Mat level_image = retargetWidth(image, maps.vertical_index_map, width);
+        Mat level_index = retargetWidth(maps.vertical_index_map, maps.vertical_index_map, width);
+
+        // Horizontal seams of the level image are vertical seams of its transpose
+        transpose(level_image, level.image_t);
+        transpose(level_index, level.vertical_index_t);
+        level.horizontal_index_t = computeSeamIndexMap(level.image_t);
+
+        maps.memory_bytes += level.image_t.total() * level.image_t.elemSize()
+            + level.vertical_index_t.total() * level.vertical_index_t.elemSize()
+            + level.horizontal_index_t.total() * level.horizontal_index_t.elemSize();
+        maps.levels.push_back(level);
+    }
+
+    maps.precompute_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    return maps;
+}
+
+// Function to retarget an image to any smaller size with its precomputed retargeting maps
+// The narrowest level at least as wide as the target is cut to the target height with its
+// horizontal map, then every row keeps the new_width pixels that the vertical map removes last.
+// The result is exact sequential carving when the target width is one of the levels.
+Mat retargetSize(const RetargetingMaps& maps, int new_width, int new_height) {
+    CV_Assert(!maps.levels.empty());
+    const RetargetingLevel* level = &maps.levels.front();
+    for (const RetargetingLevel& candidate : maps.levels) {
+        if (candidate.width >= new_width)
+            level = &candidate;
+    }
+    CV_Assert(new_width > 0 && new_width <= level->width);
+    CV_Assert(new_height > 0 && new_height <= level->image_t.cols);
+
+    // Gather the target height from the level, carrying the vertical indices along
+    Mat image, vertical_index;
+    transpose(retargetWidth(level->image_t, level->horizontal_index_t, new_height), image);
+    transpose(retargetWidth(level->vertical_index_t, level->horizontal_index_t, new_height), vertical_index);
+    if (level->width == new_width)
+        return image;
+
+    // Keep the pixels with the highest vertical seam index in every row, in their original order
+    Mat output(new_height, new_width, image.type());
+    size_t pixel_size = image.elemSize();
+    vector<pair<int, int>> order(image.cols);
+    vector<int> kept(new_width);
+
+    for (int i = 0; i < new_height; i++) {
+        const int* index = vertical_index.ptr<int>(i);
+        for (int j = 0; j < image.cols; j++)
+            order[j] = make_pair(-index[j], j);
+        nth_element(order.begin(), order.begin() + new_width, order.end());
+        for (int j = 0; j < new_width; j++)
+            kept[j] = order[j].second;
+        sort(kept.begin(), kept.end());
+
+        const uchar* src = image.ptr<uchar>(i);
+        uchar* dst = output.ptr<uchar>(i);
+        for (int j = 0; j < new_width; j++)
+            memcpy(dst + j * pixel_size, src + kept[j] * pixel_size, pixel_size);
+    }
+
+    return output;
+}
+
+// Function to measure how far a map lookup deviates from exact sequential carving
+// Returns the mean absolute difference per channel between the two results
+double measureRetargetingDeviation(const Mat& image, const RetargetingMaps& maps, int new_width, int new_height) {
+    // Exact result: vertical seams first, then horizontal seams, both with dynamic programming
+    Mat exact = retargetWidth(image, maps.vertical_index_map, new_width);
+    removeHorizontalSeams(exact, image.rows - new_height, removeVerticalSeamDP);
+
+    Mat approximate = retargetSize(maps, new_width, new_height);
+    return norm(exact, approximate, NORM_L1) / (double)(exact.total() * exact.channels());
+}
+
+// Function to print the precompute cost of the retargeting maps and their deviation on probe sizes
+// The probes sit halfway between width levels, where the lookup is furthest from exact carving
+void reportRetargetingMaps(const Mat& image, const RetargetingMaps& maps) {
+    cout << "Retargeting maps: " << maps.levels.size() << " width levels, computed in "
+        << maps.precompute_ms << " ms, " << (maps.memory_bytes >> 20) << " MB" << endl;
+
+    int new_height = max(1, image.rows / 2);
+    for (size_t k = 0; k + 1 < maps.levels.size(); k++) {
+        int new_width = (maps.levels[k].width + maps.levels[k + 1].width) / 2;
+        cout << "  " << new_width << " x " << new_height << ": mean deviation "
+            << measureRetargetingDeviation(image, maps, new_width, new_height) << " per channel" << endl;
+    }
+}
+
+// Energy functions a seam index map can be computed with, recorded in the sidecar header
+enum SeamEnergyMode {
+    SEAM_ENERGY_SOBEL = 0  // computeEnergyMap: mean of the absolute Sobel gradients
+};
+
+// Seam index map sidecar file (for example castle.seams next to castle.png)
+// All fields are little endian. The file is laid out to be memory-mapped and decoded row by row:
+//   header | row table (one SeamSidecarRow per image row) | encoded rows
+// Each row stores the seam indices of its pixels left to right as zigzag deltas between neighbours,
+// either as raw 32-bit words or as LEB128 varints when SIDECAR_FLAG_VARINT is set.
+// The header, the row table and every row carry a CRC-32, and the header also holds the CRC-32 of the
+// decoded source pixels so a map is never replayed on an image edited since.
+const char SIDECAR_MAGIC[8] = { 'S', 'E', 'A', 'M', 'I', 'D', 'X', '\0' };
+const uint32_t SIDECAR_VERSION = 2;
+const uint32_t SIDECAR_FLAG_VARINT = 1;
+
+struct SeamSidecarHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t energy_mode;
+    uint32_t flags;
+    uint32_t row_table_crc;  // CRC-32 of the row table
+    uint64_t payload_offset; // Offset of the first encoded row from the start of the file
+    uint64_t payload_size;
+    uint32_t source_crc;     // CRC-32 of the decoded source pixels, see imageChecksum
+    uint32_t header_crc;     // CRC-32 of all the header bytes before this field
+};
+
+struct SeamSidecarRow {
+    uint64_t offset;         // Offset of the encoded row from the start of the payload
+    uint32_t size;
+    uint32_t crc;            // CRC-32 of the encoded row
+};
+
+static_assert(sizeof(SeamSidecarHeader) == 56, "Unexpected sidecar header layout");
+static_assert(sizeof(SeamSidecarRow) == 16, "Unexpected sidecar row layout");
+
+// Function to compute the CRC-32 (IEEE) of a buffer
+uint32_t crc32(const uchar* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static once_flag table_once;
+    call_once(table_once, []() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    });
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Function to compute the CRC-32 of the decoded pixels of an image, row by row
+uint32_t imageChecksum(const Mat& image) {
+    uint32_t crc = 0;
+    size_t row_size = image.cols * image.elemSize();
+    for (int i = 0; i < image.rows; i++)
+        crc = crc32(image.ptr<uchar>(i), row_size, crc);
+    return crc;
+}
+
+// Function to encode one row of a seam index map into the sidecar row format
+void encodeSidecarRow(const int* index, int cols, bool varint, vector<uchar>& out) {
+    int previous = 0;
+    for (int j = 0; j < cols; j++) {
+        // Zigzag maps small negative deltas to small unsigned values
+        int delta = index[j] - previous;
+        uint32_t value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        previous = index[j];
+
+        if (varint) {
+            while (value >= 0x80) {
+                out.push_back((uchar)(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((uchar)value);
+        }
+        else {
+            for (int b = 0; b < 4; b++)
+                out.push_back((uchar)(value >> (8 * b)));
+        }
+    }
+}
+
+// Function to write the seam index map of a source image to a sidecar file
+bool writeSeamSidecar(const string& path, const Mat& source, const Mat& index_map, SeamEnergyMode energy_mode,
+                      bool varint = true) {
+    CV_Assert(index_map.type() == CV_32S && index_map.size() == source.size());
+    int rows = index_map.rows;
+    int cols = index_map.cols;
+
+    // Encode all rows and build the row table
+    vector<uchar> payload;
+    vector<SeamSidecarRow> row_table(rows);
+    for (int i = 0; i < rows; i++) {
+        size_t offset = payload.size();
+        encodeSidecarRow(index_map.ptr<int>(i), cols, varint, payload);
+        row_table[i].offset = offset;
+        row_table[i].size = (uint32_t)(payload.size() - offset);
+        row_table[i].crc = crc32(payload.data() + offset, row_table[i].size);
+    }
+
+    SeamSidecarHeader header = {};
+    memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+    header.version = SIDECAR_VERSION;
+    header.width = cols;
+    header.height = rows;
+    header.energy_mode = energy_mode;
+    header.flags = varint ? SIDECAR_FLAG_VARINT : 0;
+    header.row_table_crc = crc32((const uchar*)row_table.data(), row_table.size() * sizeof(SeamSidecarRow));
+    header.payload_offset = sizeof(SeamSidecarHeader) + row_table.size() * sizeof(SeamSidecarRow);
+    header.payload_size = payload.size();
+    header.source_crc = imageChecksum(source);
+    header.header_crc = crc32((const uchar*)&header, offsetof(SeamSidecarHeader, header_crc));
+
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)row_table.data(), row_table.size() * sizeof(SeamSidecarRow));
+    file.write((const char*)payload.data(), payload.size());
+    return (bool)file;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        bytes = (const uchar*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        length = (size_t)file_size.QuadPart;
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        bytes = ptr == MAP_FAILED ? nullptr : (const uchar*)ptr;
+        length = (size_t)st.st_size;
+#endif
+        if (!bytes) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes)
+            UnmapViewOfFile(bytes);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes)
+            munmap((void*)bytes, length);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const uchar* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    const uchar* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Memory-mapped seam index map sidecar
+// Opening validates the header and the row table only; rows are checked and decoded on demand
+class SeamSidecar {
+public:
+    bool open(const string& path, string& error) {
+        if (!file.open(path)) {
+            error = "cannot map " + path;
+            return false;
+        }
+
+        // Validate the header
+        if (file.size() < sizeof(SeamSidecarHeader)) {
+            error = "truncated header";
+            return false;
+        }
+        header = (const SeamSidecarHeader*)file.data();
+        if (memcmp(header->magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0) {
+            error = "not a seam index sidecar";
+            return false;
+        }
+        if (header->version != SIDECAR_VERSION) {
+            error = format("unsupported version %u", header->version);
+            return false;
+        }
+        if (header->header_crc != crc32(file.data(), offsetof(SeamSidecarHeader, header_crc))) {
+            error = "header checksum mismatch";
+            return false;
+        }
+
+        // Validate the row table and the payload bounds, in a form that cannot wrap around
+        size_t table_size = (size_t)header->height * sizeof(SeamSidecarRow);
+        if (header->payload_offset != sizeof(SeamSidecarHeader) + table_size || header->payload_offset > file.size()
+            || header->payload_size > file.size() - header->payload_offset) {
+            error = "truncated file";
+            return false;
+        }
+        row_table = (const SeamSidecarRow*)(file.data() + sizeof(SeamSidecarHeader));
+        if (header->row_table_crc != crc32((const uchar*)row_table, table_size)) {
+            error = "row table checksum mismatch";
+            return false;
+        }
+        for (uint32_t i = 0; i < header->height; i++) {
+            if (row_table[i].offset > header->payload_size || row_table[i].size > header->payload_size - row_table[i].offset) {
+                error = format("row %u out of bounds", i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int width() const { return (int)header->width; }
+    int height() const { return (int)header->height; }
+    SeamEnergyMode energyMode() const { return (SeamEnergyMode)header->energy_mode; }
+    uint32_t sourceChecksum() const { return header->source_crc; }
+
+    // Function to decode the seam indices of one row, touching only that row's bytes
+    // Every index is checked to lie in [0, width); the checksums alone do not make a row valid
+    void decodeRow(int i, int* index) const {
+        CV_Assert(i >= 0 && i < height());
+        const SeamSidecarRow& row = row_table[i];
+        const uchar* src = file.data() + header->payload_offset + row.offset;
+        const uchar* end = src + row.size;
+        if (crc32(src, row.size) != row.crc)
+            CV_Error(Error::StsParseError, format("Seam sidecar row %d checksum mismatch", i));
+
+        bool varint = (header->flags & SIDECAR_FLAG_VARINT) != 0;
+        uint32_t previous = 0;
+        for (int j = 0; j < width(); j++) {
+            uint32_t value = 0;
+            if (varint) {
+                for (int shift = 0;; shift += 7) {
+                    if (src == end || shift > 28)
+                        CV_Error(Error::StsParseError, format("Seam sidecar row %d is malformed", i));
+                    value |= (uint32_t)(*src & 0x7F) << shift;
+                    if (!(*src++ & 0x80))
+                        break;
+                }
+            }
+            else {
+                if (end - src < 4)
+                    CV_Error(Error::StsParseError, format("Seam sidecar row %d is malformed", i));
+                value = src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+                src += 4;
+            }
+
+            // Undo the zigzag and delta encoding, wrapping like the encoder did
+            previous += (value >> 1) ^ (0u - (value & 1));
+            if (previous >= (uint32_t)width())
+                CV_Error(Error::StsParseError, format("Seam sidecar row %d has an index out of range", i));
+            index[j] = (int)previous;
+        }
+    }
+
+private:
+    MappedFile file;
+    const SeamSidecarHeader* header = nullptr;
+    const SeamSidecarRow* row_table = nullptr;
+};
+
+// Function to retarget a band of rows of an image to a smaller width straight from a sidecar
+// Only the sidecar rows in the band are read and decoded
+Mat retargetWidth(const Mat& image, const SeamSidecar& sidecar, int new_width, Range rows = Range::all()) {
+    CV_Assert(sidecar.width() == image.cols && sidecar.height() == image.rows);
+    CV_Assert(new_width > 0 && new_width <= image.cols);
+    if (rows == Range::all())
+        rows = Range(0, image.rows);
+
+    int threshold = image.cols - new_width;
+    size_t pixel_size = image.elemSize();
+    Mat output(rows.size(), new_width, image.type());
+    vector<int> index(image.cols);
+
+    for (int i = rows.start; i < rows.end; i++) {
+        sidecar.decodeRow(i, index.data());
+
+        // Keep the pixels whose seam index is at least the threshold
+        // A row that is not a permutation of the seam indices would keep the wrong number of pixels
+        const uchar* src = image.ptr<uchar>(i);
+        uchar* dst = output.ptr<uchar>(i - rows.start);
+        int kept = 0;
+        for (int j = 0; j < image.cols; j++) {
+            if (index[j] >= threshold) {
+                if (++kept > new_width)
+                    break;
+                memcpy(dst, src + j * pixel_size, pixel_size);
+                dst += pixel_size;
+            }
+        }
+        if (kept != new_width)
+            CV_Error(Error::StsParseError, format("Seam sidecar row %d does not hold one seam index per pixel", i));
+    }
+
+    return output;
+}
+
+// Function to derive the sidecar path of an image file (castle.png -> castle.seams)
+string sidecarPath(const string& filename) {
+    size_t dot = filename.find_last_of('.');
+    return (dot == string::npos ? filename : filename.substr(0, dot)) + ".seams";
+}
+
+// Function to open the sidecar stored next to an image, if there is a valid one for it
+unique_ptr<SeamSidecar> openSeamSidecar(const string& filename, const Mat& image) {
+    unique_ptr<SeamSidecar> sidecar(new SeamSidecar());
+    string path = sidecarPath(filename), error;
+    if (!sidecar->open(path, error)) {
+        // A missing sidecar is the normal case, anything else is worth a warning
+        ifstream exists(path);
+        if (exists)
+            cout << "Ignoring seam sidecar " << path << ": " << error << endl;
+        return nullptr;
+    }
+    if (sidecar->width() != image.cols || sidecar->height() != image.rows || sidecar->energyMode() != SEAM_ENERGY_SOBEL) {
+        cout << "Ignoring seam sidecar " << path << ": it was computed for a different image" << endl;
+        return nullptr;
+    }
+    if (sidecar->sourceChecksum() != imageChecksum(image)) {
+        cout << "Ignoring seam sidecar " << path << ": the image has changed since it was computed" << endl;
+        return nullptr;
+    }
+    cout << "Using seam sidecar " << path << endl;
+    return sidecar;
+}
+
+// Function to carve an image to a target size with dynamic programming using whatever precomputed data is at hand
+// Retargeting maps answer by lookup; otherwise the vertical phase is gathered from the seam index map
+// (in memory or from the sidecar) and only the horizontal phase is carved
+Mat retargetDP(const Mat& image, Size target, const Mat& seam_index_map, const SeamSidecar* seam_sidecar,
+               const RetargetingMaps& retargeting_maps) {
+    if (!retargeting_maps.levels.empty())
+        return retargetSize(retargeting_maps, target.width, target.height);
+
+    Mat result;
+    if (target.width == image.cols)
+        result = image.clone();
+    else if (!seam_index_map.empty())
+        result = retargetWidth(image, seam_index_map, target.width);
+    else if (seam_sidecar) {
+        // A corrupt sidecar row falls back to carving the seams
+        try {
+            result = retargetWidth(image, *seam_sidecar, target.width);
+        }
+        catch (const Exception& e) {
+            cout << "Ignoring seam sidecar: " << e.err << endl;
+        }
+    }
+    if (result.empty())
+        result = carveToSizes(image, { Size(target.width, image.rows) }, removeVerticalSeamDP)[0];
+
+    // Remove horizontal seams using Dynamic Programming
+    removeHorizontalSeams(result, image.rows - target.height, removeVerticalSeamDP);
+    return result;
+}
+
+// Scratch file of fixed-size tiles, mapped into memory a few tiles at a time
+// At most max_mapped tiles are mapped; touching another one unmaps the least recently used, so resident
+// memory stays bounded however large the file is. The file is deleted when closed.
+// A pointer returned by tile() is only valid until the next call.
+class TiledFile {
+public:
+    // Tiles are a multiple of the Windows allocation granularity, which also covers the POSIX page size
+    static const size_t TILE_ALIGNMENT = 64 << 10;
+
+    TiledFile() {}
+    TiledFile(const TiledFile&) = delete;
+    TiledFile& operator=(const TiledFile&) = delete;
+
+    ~TiledFile() {
+        close();
+    }
+
+    bool create(const string& path, size_t min_tile_bytes, size_t num_tiles, size_t max_mapped) {
+        close();
+        tile_bytes = alignSize(max(min_tile_bytes, (size_t)1), (int)TILE_ALIGNMENT);
+        max_mapped_tiles = max(max_mapped, (size_t)1);
+        uint64_t file_size = (uint64_t)tile_bytes * num_tiles;
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)(file_size >> 32), (DWORD)file_size, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0)
+            return false;
+
+        // The name goes right away; the sparse file lives until it is closed
+        unlink(path.c_str());
+        if (ftruncate(fd, (off_t)file_size) != 0) {
+            close();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    uchar* tile(size_t index) {
+        use_clock++;
+        for (MappedTile& mapped_tile : mapped) {
+            if (mapped_tile.index == index) {
+                mapped_tile.last_use = use_clock;
+                return mapped_tile.data;
+            }
+        }
+
+        // Evict the least recently used tile once the window is full
+        if (mapped.size() >= max_mapped_tiles) {
+            auto oldest = min_element(mapped.begin(), mapped.end(),
+                [](const MappedTile& a, const MappedTile& b) { return a.last_use < b.last_use; });
+            unmap(oldest->data);
+            mapped.erase(oldest);
+        }
+
+        uint64_t offset = (uint64_t)index * tile_bytes;
+#ifdef _WIN32
+        uchar* data = (uchar*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, (DWORD)(offset >> 32), (DWORD)offset, tile_bytes);
+#else
+        void* ptr = mmap(nullptr, tile_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)offset);
+        uchar* data = ptr == MAP_FAILED ? nullptr : (uchar*)ptr;
+#endif
+        if (!data)
+            CV_Error(Error::StsError, "cannot map a tile of the out-of-core scratch file");
+        mapped.push_back({ index, data, use_clock });
+        peak_mapped_bytes = max(peak_mapped_bytes, mapped.size() * tile_bytes);
+        return data;
+    }
+
+    size_t tileBytes() const { return tile_bytes; }
+    size_t peakMappedBytes() const { return peak_mapped_bytes; }
+
+    void close() {
+        for (MappedTile& mapped_tile : mapped)
+            unmap(mapped_tile.data);
+        mapped.clear();
+#ifdef _WIN32
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+    }
+
+private:
+    struct MappedTile {
+        size_t index;
+        uchar* data;
+        uint64_t last_use;
+    };
+
+    void unmap(uchar* data) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, tile_bytes);
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    size_t tile_bytes = 0;
+    size_t max_mapped_tiles = 1;
+    vector<MappedTile> mapped;
+    uint64_t use_clock = 0;
+    size_t peak_mapped_bytes = 0;
+};
+
+// Image carved out of core, for images that do not fit in memory as a Mat
+// Pixels and the seam directions of the dynamic programming pass live in tiled scratch files. Each stored
+// row holds its pixels followed by a bitmap of tombstones: removing a seam sets one tombstone per row instead
+// of shifting the row, and a row is only compacted once an eighth of its stored pixels are dead.
+// The energy and the cumulative energy are streamed through band by band; only one row of cumulative
+// energy and a band of rows are held in memory besides the mapped tiles.
+class OutOfCoreCarver {
+public:
+    // Rows per tile of the pixel and direction files
+    static const int TILE_ROWS = 16;
+
+    // Function to create the scratch files for an image of the given size and type
+    // Three quarters of the memory limit go to the pixel tiles, the rest to the direction tiles
+    bool create(const string& scratch_prefix, int rows, int cols, int type, size_t memory_limit) {
+        num_rows = rows;
+        width = cols;
+        capacity = cols;
+        pixel_type = type;
+        pixel_size = CV_ELEM_SIZE(type);
+        row_bytes = alignSize(cols * pixel_size + (cols + 7) / 8, 8);
+        stored_width.assign(rows, cols);
+        dead.assign(rows, 0);
+
+        size_t num_tiles = (rows + TILE_ROWS - 1) / TILE_ROWS;
+        size_t pixel_tile_bytes = alignSize(row_bytes * TILE_ROWS, (int)TiledFile::TILE_ALIGNMENT);
+        size_t direction_tile_bytes = alignSize((size_t)cols * TILE_ROWS, (int)TiledFile::TILE_ALIGNMENT);
+        return pixels.create(scratch_prefix + ".pixels", pixel_tile_bytes, num_tiles, max((size_t)2, memory_limit * 3 / 4 / pixel_tile_bytes))
+            && directions.create(scratch_prefix + ".directions", direction_tile_bytes, num_tiles, max((size_t)2, memory_limit / 4 / direction_tile_bytes));
+    }
+
+    int rows() const { return num_rows; }
+    int cols() const { return width; }
+    size_t peakMappedBytes() const { return pixels.peakMappedBytes() + directions.peakMappedBytes(); }
+
+    // Function to store a row of the original image, before any seam is removed
+    void writeRow(int r, const uchar* row_pixels) {
+        uchar* row = storedRow(r);
+        memcpy(row, row_pixels, width * pixel_size);
+        memset(row + stored_width[r] * pixel_size, 0, (stored_width[r] + 7) / 8);
+    }
+
+    // Function to read the live pixels of a row, skipping tombstones
+    void readRow(int r, uchar* row_pixels) {
+        const uchar* row = storedRow(r);
+        if (!dead[r]) {
+            memcpy(row_pixels, row, width * pixel_size);
+            return;
+        }
+        const uchar* tombstones = row + stored_width[r] * pixel_size;
+        for (int j = 0; j < stored_width[r]; j++) {
+            if (!(tombstones[j >> 3] & (1 << (j & 7)))) {
+                memcpy(row_pixels, row + j * pixel_size, pixel_size);
+                row_pixels += pixel_size;
+            }
+        }
+    }
 
-    // Convert the input image to grayscale
-    cvtColor(image, gray, COLOR_BGR2GRAY);
+    // Function to read a band of rows into a Mat
+    Mat readRows(int start, int end) {
+        Mat band(end - start, width, pixel_type);
+        for (int r = start; r < end; r++)
+            readRow(r, band.ptr<uchar>(r - start));
+        return band;
+    }
 
-    // Compute gradients along the X-axis using the Sobel operator
-    Sobel(gray, grad_x, CV_16S, 1, 0, 3);
+    // Function to find and remove the vertical seam of minimum energy
+    // Gives the same seam as findVerticalSeamDP on the whole image
+    void removeVerticalSeam() {
+        vector<int> previous(width), current(width);
 
-    // Compute gradients along the Y-axis using the Sobel operator
-    Sobel(gray, grad_y, CV_16S, 0, 1, 3);
+        // Forward pass: stream the energy band by band, keep one row of cumulative energy and
+        // store the direction of each pixel's cheapest parent
+        for (int band_start = 0; band_start < num_rows; band_start += TILE_ROWS) {
+            int band_end = min(num_rows, band_start + TILE_ROWS);
+            Mat energy = bandEnergy(band_start, band_end);
 
-    // Convert the gradient images to absolute values
-    convertScaleAbs(grad_x, abs_grad_x);
-    convertScaleAbs(grad_y, abs_grad_y);
+            for (int i = band_start; i < band_end; i++) {
+                const uchar* energy_row = energy.ptr<uchar>(i - band_start);
+                if (i == 0) {
+                    for (int j = 0; j < width; j++)
+                        previous[j] = energy_row[j];
+                    continue;
+                }
 
-    // Combine the absolute gradients to form the energy map
-    // Each pixel's energy is the sum of its absolute gradients in X and Y
-    addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, energy_map);
+                schar* direction = (schar*)directionRow(i);
+                for (int j = 0; j < width; j++) {
+                    // Same preference as backtrackVerticalSeam: straight up, then left, then right
+                    int min_energy = previous[j];
+                    schar step = 0;
+                    if (j > 0 && previous[j - 1] < min_energy) {
+                        min_energy = previous[j - 1];
+                        step = -1;
+                    }
+                    if (j < width - 1 && previous[j + 1] < min_energy) {
+                        min_energy = previous[j + 1];
+                        step = 1;
+                    }
+                    current[j] = energy_row[j] + min_energy;
+                    direction[j] = step;
+                }
+                swap(previous, current);
+            }
+        }
 
-    return energy_map;
-}
+        // Backtrack through the direction file from the cheapest end point
+        vector<int> seam(num_rows);
+        seam[num_rows - 1] = (int)(min_element(previous.begin(), previous.end()) - previous.begin());
+        for (int i = num_rows - 1; i > 0; i--)
+            seam[i - 1] = seam[i] + ((const schar*)directionRow(i))[seam[i]];
 
-// Function to find and remove a vertical seam using dynamic programming
-void removeVerticalSeamDP(Mat& image) {
-    // Compute the energy map of the current image
-    Mat energy_map = computeEnergyMap(image);
-    int rows = energy_map.rows;
-    int cols = energy_map.cols;
+        // Tombstone the seam pixels
+        for (int i = 0; i < num_rows; i++)
+            removePixel(i, seam[i]);
+        width--;
+    }
 
-    // Initialize the cumulative energy map with zeros
-    Mat M = Mat::zeros(rows, cols, CV_32S);
+    // Function to copy the whole image into a Mat, for results that fit in memory
+    Mat toMat() {
+        return readRows(0, num_rows);
+    }
 
-    // Copy the first row of the energy map to the cumulative energy map
-    energy_map.row(0).convertTo(M.row(0), CV_32S);
+private:
+    uchar* storedRow(int r) {
+        return pixels.tile(r / TILE_ROWS) + (size_t)(r % TILE_ROWS) * row_bytes;
+    }
 
-    // Compute the cumulative energy map by dynamic programming
-    for (int i = 1; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            // Start with the energy from the pixel directly above
-            int min_energy = M.at<int>(i - 1, j);
+    uchar* directionRow(int r) {
+        return directions.tile(r / TILE_ROWS) + (size_t)(r % TILE_ROWS) * capacity;
+    }
 
-            // Check the pixel to the top-left, if it exists
-            if (j > 0)
-                min_energy = min(min_energy, M.at<int>(i - 1, j - 1));
+    // Function to compute the energy of a band of rows, reading one more row on either side
+    // so the Sobel filters see the same neighbours as on the whole image
+    Mat bandEnergy(int start, int end) {
+        int halo_start = max(0, start - 1);
+        int halo_end = min(num_rows, end + 1);
+        Mat energy = computeEnergyMap(readRows(halo_start, halo_end));
+        return energy.rowRange(start - halo_start, end - halo_start);
+    }
 
-            // Check the pixel to the top-right, if it exists
-            if (j < cols - 1)
-                min_energy = min(min_energy, M.at<int>(i - 1, j + 1));
+    // Function to tombstone the pixel at a live column of a row, compacting the row when enough of it is dead
+    void removePixel(int r, int x) {
+        uchar* row = storedRow(r);
+        uchar* tombstones = row + stored_width[r] * pixel_size;
 
-            // Update the cumulative energy for the current pixel
-            M.at<int>(i, j) = energy_map.at<uchar>(i, j) + min_energy;
+        // Find the stored position of the live column
+        int j = 0;
+        for (int live = -1; ; j++) {
+            if (!(tombstones[j >> 3] & (1 << (j & 7))) && ++live == x)
+                break;
         }
-    }
+        tombstones[j >> 3] |= (uchar)(1 << (j & 7));
 
-    // Backtrack to find the path of the seam with the minimum energy
-    vector<int> seam(rows);
-    int min_idx = 0;
-    int min_val = M.at<int>(rows - 1, 0);
+        if (++dead[r] * 8 < stored_width[r])
+            return;
 
-    // Find the position in the last row with the minimum cumulative energy
-    for (int j = 1; j < cols; j++) {
-        if (M.at<int>(rows - 1, j) < min_val) {
-            min_val = M.at<int>(rows - 1, j);
-            min_idx = j;
+        // Compact: shift the live pixels over the dead ones and start a fresh bitmap after them
+        vector<uchar> bits(tombstones, tombstones + (stored_width[r] + 7) / 8);
+        int live = 0;
+        for (j = 0; j < stored_width[r]; j++) {
+            if (!(bits[j >> 3] & (1 << (j & 7)))) {
+                if (live != j)
+                    memmove(row + live * pixel_size, row + j * pixel_size, pixel_size);
+                live++;
+            }
         }
+        stored_width[r] = live;
+        dead[r] = 0;
+        memset(row + live * pixel_size, 0, (live + 7) / 8);
     }
-    seam[rows - 1] = min_idx;
 
-    // Trace the seam path from bottom to top
-    for (int i = rows - 2; i >= 0; i--) {
-        int prev_x = seam[i + 1];
-        int min_energy = M.at<int>(i, prev_x);
-        min_idx = prev_x;
+    TiledFile pixels, directions;
+    int num_rows = 0;
+    int width = 0;
+    int capacity = 0;           // Width of the original image, the stride of the direction rows
+    int pixel_type = 0;
+    size_t pixel_size = 0;
+    size_t row_bytes = 0;
+    vector<int> stored_width;   // Stored pixels of each row, live or dead
+    vector<int> dead;           // Tombstones of each row since its last compaction
+};
 
-        // Check the top-left neighbor
-        if (prev_x > 0 && M.at<int>(i, prev_x - 1) < min_energy) {
-            min_energy = M.at<int>(i, prev_x - 1);
-            min_idx = prev_x - 1;
+// Function to fill a row of a synthetic test image: a checkerboard of 64 pixel blocks with noise
+void syntheticRow(int r, Mat& row) {
+    RNG rng(r + 1);
+    rng.fill(row, RNG::UNIFORM, 0, 48);
+    uchar* pixels = row.ptr<uchar>();
+    int cn = row.channels();
+    for (int j = 0; j < row.cols; j++) {
+        if ((j / 64 + r / 64) % 2) {
+            for (int c = 0; c < cn; c++)
+                pixels[j * cn + c] += 160;
         }
+    }
+}
 
-        // Check the top-right neighbor
-        if (prev_x < cols - 1 && M.at<int>(i, prev_x + 1) < min_energy) {
-            min_energy = M.at<int>(i, prev_x + 1);
-            min_idx = prev_x + 1;
-        }
+// Function to check the out-of-core engine
+// First a small image is carved under a memory limit that forces tiles to be evicted and must match
+// in-memory dynamic programming exactly. Then a synthetic image of the given size, generated row by row,
+// is carved under the memory limit, and the peak of mapped tiles must stay within it.
+bool checkOutOfCore(int width, int height, size_t memory_limit, int num_seams) {
+    bool passed = true;
 
-        // Update the seam path
-        seam[i] = min_idx;
+    // Exactness against the in-memory engine
+    Mat small_image(131, 257, CV_8UC3);
+    for (int r = 0; r < small_image.rows; r++) {
+        Mat row = small_image.row(r);
+        syntheticRow(r, row);
+    }
+    OutOfCoreCarver small_carver;
+    if (!small_carver.create("ooc_check_small", small_image.rows, small_image.cols, small_image.type(), 256 << 10)) {
+        cout << "Could not create the out-of-core scratch files" << endl;
+        return false;
     }
+    for (int r = 0; r < small_image.rows; r++)
+        small_carver.writeRow(r, small_image.ptr<uchar>(r));
 
-    // Create an output image with one less column to remove the seam
-    Mat output(rows, cols - 1, CV_8UC3);
+    Mat in_memory = small_image.clone();
+    for (int k = 0; k < 20; k++) {
+        small_carver.removeVerticalSeam();
+        removeVerticalSeamDP(in_memory);
+    }
+    Mat out_of_core = small_carver.toMat();
+    bool exact = out_of_core.size() == in_memory.size() && norm(out_of_core, in_memory, NORM_INF) == 0;
+    cout << "  " << small_image.cols << " x " << small_image.rows << ", 20 seams against in-memory DP: "
+        << (exact ? "identical" : "DIFFERENT") << endl;
+    passed &= exact;
 
-    // Iterate through each row to remove the seam
-    for (int i = 0; i < rows; i++) {
-        int idx = seam[i];
-        for (int j = 0; j < idx; j++) {
-            // Copy pixels before the seam
-            output.at<Vec3b>(i, j) = image.at<Vec3b>(i, j);
-        }
-        for (int j = idx + 1; j < cols; j++) {
-            // Shift pixels after the seam to the left by one
-            output.at<Vec3b>(i, j - 1) = image.at<Vec3b>(i, j);
-        }
+    // A synthetic image much larger than the memory limit
+    OutOfCoreCarver carver;
+    if (!carver.create("ooc_check_large", height, width, CV_8UC3, memory_limit)) {
+        cout << "Could not create the out-of-core scratch files" << endl;
+        return false;
+    }
+    Mat row(1, width, CV_8UC3);
+    for (int r = 0; r < height; r++) {
+        syntheticRow(r, row);
+        carver.writeRow(r, row.ptr<uchar>());
     }
 
-    // Update the original image with the seam removed
-    image = output.clone();
+    int64 start = getTickCount();
+    for (int k = 0; k < num_seams; k++)
+        carver.removeVerticalSeam();
+    double elapsed_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    size_t image_bytes = (size_t)width * height * 3;
+    bool bounded = carver.peakMappedBytes() <= memory_limit && carver.cols() == width - num_seams;
+    cout << "  " << width << " x " << height << " (" << (image_bytes >> 20) << " MB, " << image_bytes / (double)memory_limit
+        << "x the limit), " << num_seams << " seams in " << elapsed_ms << " ms, peak mapped "
+        << (carver.peakMappedBytes() >> 10) << " KB of " << (memory_limit >> 10) << " KB: "
+        << (bounded ? "within the limit" : "OVER THE LIMIT") << endl;
+    passed &= bounded;
+
+    return passed;
 }
 
-// Function to find and remove a horizontal seam using dynamic programming
-void removeHorizontalSeamDP(Mat& image) {
-    // Transpose the image to reuse the vertical seam removal function
-    Mat transposed_image;
-    transpose(image, transposed_image);
+// Mat allocator for long running carving processes
+// Every seam allocates a new image one column narrower, so the same buffer sizes recur all the time
+// Freed buffers are kept in size classes and handed out again instead of going back to malloc
+class CarveAllocator : public MatAllocator {
+public:
+    // Rows are padded to this many bytes so SIMD kernels see aligned row starts
+    static const size_t ROW_ALIGNMENT = 64;
 
-    // Flip the transposed image vertically to maintain orientation
-    flip(transposed_image, transposed_image, 0);
+    // Buffers at least this large are hugepage aligned and advised as such
+    static const size_t HUGEPAGE_SIZE = 2 << 20;
 
-    // Remove a vertical seam from the transposed image
-    removeVerticalSeamDP(transposed_image);
+    explicit CarveAllocator(size_t max_cached_bytes = size_t(512) << 20, bool align_rows = true)
+        : max_cached_bytes(max_cached_bytes), align_rows(align_rows) {}
 
-    // Flip the image back vertically after seam removal
-    flip(transposed_image, transposed_image, 0);
+    ~CarveAllocator() {
+        // Release every buffer still held for recycling
+        for (auto& size_class : free_lists) {
+            for (void* ptr : size_class.second)
+                alignedFree(ptr);
+        }
+    }
 
-    // Transpose the image back to its original orientation
-    transpose(transposed_image, image);
-}
+    UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                       AccessFlag, UMatUsageFlags) const CV_OVERRIDE {
+        // Compute the steps, padding the rows of freshly allocated 2D images
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != Mat::AUTO_STEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                }
+                else {
+                    if (!data0 && align_rows && dims == 2 && i == 0 && sizes[0] > 1)
+                        total = alignSize(total, (int)ROW_ALIGNMENT);
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
 
-// Function to find and remove a vertical seam using a greedy algorithm
-void removeVerticalSeamGreedy(Mat& image) {
-    // Compute the energy map of the current image
-    Mat energy_map = computeEnergyMap(image);
-    int rows = energy_map.rows;
-    int cols = energy_map.cols;
+        UMatData* u = new UMatData(this);
+        if (data0) {
+            u->data = u->origdata = (uchar*)data0;
+            u->size = total;
+            u->flags |= UMatData::USER_ALLOCATED;
+            return u;
+        }
 
-    // Initialize the seam path
-    vector<int> seam(rows);
+        // Reuse a cached buffer of the same size class when one is available
+        size_t capacity = sizeClass(total);
+        void* ptr = nullptr;
+        {
+            lock_guard<mutex> lock(free_lists_mutex);
+            auto it = free_lists.find(capacity);
+            if (it != free_lists.end() && !it->second.empty()) {
+                ptr = it->second.back();
+                it->second.pop_back();
+                cached_bytes -= capacity;
+                recycled_allocations++;
+            }
+        }
+        if (!ptr) {
+            ptr = allocateBuffer(capacity);
+            if (!ptr)
+                CV_Error(Error::StsNoMem, format("Failed to allocate %llu bytes", (unsigned long long)capacity));
+        }
 
-    // Start from the top row and find the pixel with the minimum energy
-    double min_val;
-    Point min_loc;
-    minMaxLoc(energy_map.row(0), &min_val, nullptr, &min_loc, nullptr);
-    seam[0] = min_loc.x;
+        // Track the full size class so the statistics reflect the memory actually held
+        stats.onAllocate(capacity);
+        u->data = u->origdata = (uchar*)ptr;
+        u->size = total;
+        return u;
+    }
 
-    // Greedily find the seam path by selecting the minimum energy neighbor at each step
-    for (int i = 1; i < rows; i++) {
-        int prev_x = seam[i - 1];
-        int min_energy = energy_map.at<uchar>(i, prev_x);
-        int min_idx = prev_x;
+    bool allocate(UMatData* u, AccessFlag, UMatUsageFlags) const CV_OVERRIDE {
+        return u != nullptr;
+    }
 
-        // Check the left neighbor
-        if (prev_x > 0 && energy_map.at<uchar>(i, prev_x - 1) < min_energy) {
-            min_energy = energy_map.at<uchar>(i, prev_x - 1);
-            min_idx = prev_x - 1;
-        }
+    void deallocate(UMatData* u) const CV_OVERRIDE {
+        if (!u)
+            return;
 
-        // Check the right neighbor
-        if (prev_x < cols - 1 && energy_map.at<uchar>(i, prev_x + 1) < min_energy) {
-            min_energy = energy_map.at<uchar>(i, prev_x + 1);
-            min_idx = prev_x + 1;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        if (!(u->flags & UMatData::USER_ALLOCATED)) {
+            size_t capacity = sizeClass(u->size);
+            stats.onFree(capacity);
+
+            // Keep the buffer for the next allocation of its size class unless the cache is full
+            bool cached = false;
+            {
+                lock_guard<mutex> lock(free_lists_mutex);
+                if (cached_bytes + capacity <= max_cached_bytes) {
+                    free_lists[capacity].push_back(u->origdata);
+                    cached_bytes += capacity;
+                    cached = true;
+                }
+            }
+            if (!cached)
+                alignedFree(u->origdata);
+            u->origdata = 0;
         }
 
-        // Update the seam path
-        seam[i] = min_idx;
+        delete u;
     }
 
-    // Create an output image with one less column to remove the seam
-    Mat output(rows, cols - 1, CV_8UC3);
+    // Usage statistics of the buffers handed out to Mats
+    const utils::AllocatorStatisticsInterface& getStatistics() const {
+        return stats;
+    }
 
-    // Iterate through each row to remove the seam
-    for (int i = 0; i < rows; i++) {
-        int idx = seam[i];
-        for (int j = 0; j < idx; j++) {
-            // Copy pixels before the seam
-            output.at<Vec3b>(i, j) = image.at<Vec3b>(i, j);
-        }
-        for (int j = idx + 1; j < cols; j++) {
-            // Shift pixels after the seam to the left by one
-            output.at<Vec3b>(i, j - 1) = image.at<Vec3b>(i, j);
+    // Number of allocations served from the recycling cache
+    uint64_t getRecycledAllocations() const {
+        return recycled_allocations.load();
+    }
+
+    // Bytes currently held in the recycling cache
+    size_t getCachedBytes() const {
+        lock_guard<mutex> lock(free_lists_mutex);
+        return cached_bytes;
+    }
+
+    // Function to return every cached buffer to the system, e.g. after a job was cancelled
+    void releaseCached() {
+        lock_guard<mutex> lock(free_lists_mutex);
+        for (auto& size_class : free_lists) {
+            for (void* ptr : size_class.second)
+                alignedFree(ptr);
         }
+        free_lists.clear();
+        cached_bytes = 0;
     }
 
-    // Update the original image with the seam removed
-    image = output.clone();
-}
+private:
+    // Round a request up to its size class
+    // Small buffers use 64-byte steps, larger ones quarter-power-of-two steps (at most 25% slack)
+    // and hugepage sized buffers whole hugepages
+    static size_t sizeClass(size_t size) {
+        if (size <= 4096)
+            return alignSize(max(size, (size_t)1), (int)ROW_ALIGNMENT);
+        if (size >= HUGEPAGE_SIZE)
+            return alignSize(size, (int)HUGEPAGE_SIZE);
 
-// Function to find and remove a horizontal seam using a greedy algorithm
-void removeHorizontalSeamGreedy(Mat& image) {
-    // Transpose the image to reuse the vertical seam removal function
-    Mat transposed_image;
-    transpose(image, transposed_image);
+        size_t power = 1;
+        while (power * 2 <= size)
+            power *= 2;
+        return alignSize(size, (int)(power / 4));
+    }
 
-    // Flip the transposed image vertically to maintain orientation
-    flip(transposed_image, transposed_image, 0);
+    static void* allocateBuffer(size_t size) {
+        size_t alignment = size >= HUGEPAGE_SIZE ? HUGEPAGE_SIZE : ROW_ALIGNMENT;
+        void* ptr = alignedAlloc(size, alignment);
 
-    // Remove a vertical seam from the transposed image using the greedy approach
-    removeVerticalSeamGreedy(transposed_image);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        // Ask for transparent hugepages on big buffers to cut TLB misses during the row scans
+        if (ptr && size >= HUGEPAGE_SIZE)
+            madvise(ptr, size, MADV_HUGEPAGE);
+#endif
 
-    // Flip the image back vertically after seam removal
-    flip(transposed_image, transposed_image, 0);
+        return ptr;
+    }
 
-    // Transpose the image back to its original orientation
-    transpose(transposed_image, image);
+    static void* alignedAlloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+        return _aligned_malloc(size, alignment);
+#else
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+    }
+
+    static void alignedFree(void* ptr) {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    size_t max_cached_bytes;
+    bool align_rows;
+
+    mutable utils::AllocatorStatistics stats;
+    mutable atomic<uint64_t> recycled_allocations{ 0 };
+    mutable mutex free_lists_mutex;
+    mutable std::map<size_t, vector<void*>> free_lists;
+    mutable size_t cached_bytes = 0;
+};
+
+// Function to print the statistics of the carving allocator
+void printAllocatorStatistics(const CarveAllocator& allocator) {
+    const utils::AllocatorStatisticsInterface& stats = allocator.getStatistics();
+    cout << "Allocator: " << stats.getNumberOfAllocations() << " allocations ("
+        << allocator.getRecycledAllocations() << " recycled), "
+        << (stats.getPeakUsage() >> 20) << " MB peak, "
+        << (stats.getCurrentUsage() >> 20) << " MB in use, "
+        << (allocator.getCachedBytes() >> 20) << " MB cached" << endl;
 }
 
 int main() {
+    // Recycle image buffers across seams instead of going through malloc for every one
+    // The allocator is never destroyed since OpenCV may release its own buffers at exit
+    CarveAllocator& allocator = *new CarveAllocator();
+    Mat::setDefaultAllocator(&allocator);
+
+    // Name the kernel tier picked for this CPU
+    cout << "Carving kernels: " << carveKernels().name << endl;
+
     string filename;
     Mat original_image;
 
@@ -226,8 +3737,8 @@ int main() {
         // Append .png to the filename
         filename += ".png";
 
-        // Load the image from the specified file
-        original_image = imread(filename);
+        // Load the image from the specified file, keeping its alpha channel and bit depth
+        original_image = imread(filename, IMREAD_UNCHANGED);
 
         // Check if the image was loaded successfully
         if (!original_image.empty()) {
@@ -243,15 +3754,42 @@ int main() {
     int original_height = original_image.rows;
     cout << "Original image dimensions: " << original_width << " x " << original_height << endl;
 
+    // Seam index map of the loaded image, computed with 'index' and reused for every width
+    // The sidecar it writes next to the image saves the precompute across runs
+    Mat seam_index_map;
+    unique_ptr<SeamSidecar> seam_sidecar = openSeamSidecar(filename, original_image);
+
+    // Cost model of the latency-budget planner, recalibrated on this machine with 'calibrate'
+    const string cost_model_path = "cost_model.yml";
+    CostModel cost_model;
+    if (cost_model.load(cost_model_path))
+        cout << "Loaded the planner cost model from " << cost_model_path << endl;
+
+    // Two-dimensional retargeting maps of the loaded image, computed on request with 'maps'
+    RetargetingMaps retargeting_maps;
+
     // Main loop to process user inputs for resizing
     while (true) {
         int new_width = -1, new_height = -1;
-        cout << "Enter the desired new width and height (e.g., 500 500), 'new' to load a new image, or '-1' to exit: ";
+        cout << "Enter the desired new width and height (e.g., 500 500, or several pairs for a batch), 'new' to load a new image, "
+            << "'index' to precompute and store the seam index map, 'maps <levels>' to precompute retargeting maps, "
+            << "'transport <width> <height> [levels]' for the optimal seam order, 'interleave <width> <height>' for the cheapest direction per step, "
+            << "'remove <mask> [expand]' to erase a masked object, 'protect <mask> <width> <height>' to keep "
+            << "masked pixels, 'roi <x> <y> <roi width> <roi height> <width> <height>' to carve inside a region, "
+            << "'beam <beam width> <width> <height>' for beam search, 'plan <budget ms> <width> <height>' to carve "
+            << "within a time budget, 'calibrate' to fit the planner to this machine, 'deadline <ms> <width> <height>' "
+            << "to carve until a deadline and resize the rest, 'hybrid <width> <height> <fraction>|auto <budget ms> "
+            << "<min energy preservation>' to scale then carve, 'batch <directory or manifest> <width> <height> ...' "
+            << "to carve many images, 'slabs <slabs> <width> <height> [directory or manifest]' for slab-parallel "
+            << "carving against global seams, 'outofcore [<width> <height> <memory MB> <seams>]' to check the "
+            << "out-of-core engine, 'progress <width> <height> [cancel after ms]' to carve with progress and "
+            << "cancellation, or '-1' to exit: ";
         string input;
         getline(cin, input);
 
         // Check if the user wants to exit the program
         if (input == "-1") {
+            printAllocatorStatistics(allocator);
             break; // Exit the loop and terminate the program
         }
         else if (input == "new") {
@@ -264,8 +3802,8 @@ int main() {
                 // Append .png to the filename
                 filename += ".png";
 
-                // Load the new image from the specified file
-                original_image = imread(filename);
+                // Load the new image from the specified file, keeping its alpha channel and bit depth
+                original_image = imread(filename, IMREAD_UNCHANGED);
 
                 // Check if the image was loaded successfully
                 if (!original_image.empty()) {
@@ -280,81 +3818,540 @@ int main() {
             original_width = original_image.cols;
             original_height = original_image.rows;
             cout << "Original image dimensions: " << original_width << " x " << original_height << endl;
+
+            // The seam index map and retargeting maps belong to the previous image
+            seam_index_map.release();
+            seam_sidecar = openSeamSidecar(filename, original_image);
+            retargeting_maps = RetargetingMaps();
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 5, "maps ") == 0) {
+            // Precompute the retargeting maps so later requests of any size are answered by lookup
+            int num_levels = atoi(input.c_str() + 5);
+            if (num_levels <= 0) {
+                cout << "Invalid input. Please enter a positive number of width levels." << endl;
+                continue;
+            }
+
+            retargeting_maps = computeRetargetingMaps(original_image, num_levels);
+            seam_index_map = retargeting_maps.vertical_index_map;
+            reportRetargetingMaps(original_image, retargeting_maps);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input == "index") {
+            // Precompute the seam index map once so any later width is a single gather pass
+            // It removes every seam of the image, so it only pays off when many widths are requested
+            int64 start = getTickCount();
+            seam_index_map = computeSeamIndexMap(original_image);
+            cout << "Seam index map computed in "
+                << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+
+            // Store the map with the image for the next run
+            if (writeSeamSidecar(sidecarPath(filename), original_image, seam_index_map, SEAM_ENERGY_SOBEL))
+                cout << "Seam index map stored in " << sidecarPath(filename) << endl;
+            else
+                cout << "Could not write the seam sidecar " << sidecarPath(filename) << endl;
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 10, "transport ") == 0) {
+            // Carve in the optimal seam order, exactly or on a coarse pyramid level
+            stringstream ss(input.substr(10));
+            int width, height, levels = 0;
+            if (!(ss >> width >> height) || (!(ss >> ws).eof() && !(ss >> levels)) || levels < 0) {
+                cout << "Invalid input. Please enter 'transport <width> <height> [pyramid levels]'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            int64 start = getTickCount();
+            vector<bool> vertical_steps;
+            Mat image_transport = levels > 0
+                ? carveTransportMapPyramid(original_image, width, height, levels, &vertical_steps)
+                : carveTransportMap(original_image, width, height, &vertical_steps);
+            cout << "Transport map carve in " << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+
+            imwrite("output_transport.png", image_transport);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 11, "interleave ") == 0) {
+            // Remove the cheaper of the best vertical and horizontal seam at every step
+            stringstream ss(input.substr(11));
+            int width, height;
+            if (!(ss >> width >> height) || (ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'interleave <width> <height>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            imwrite("output_interleaved.png", compareInterleavedCarve(original_image, width, height));
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 7, "remove ") == 0) {
+            // Erase the object under a mask image, optionally growing back to the original size
+            stringstream ss(input.substr(7));
+            string mask_name, option;
+            ss >> mask_name >> option;
+            Mat removal_mask = imread(mask_name + ".png", IMREAD_GRAYSCALE);
+            if (removal_mask.empty() || removal_mask.size() != original_image.size()) {
+                cout << "Could not open a removal mask of " << original_width << " x " << original_height
+                    << " named " << mask_name << ".png" << endl;
+                continue;
+            }
+
+            int64 start = getTickCount();
+            Mat image_removed = removeObject(original_image, removal_mask > 0, 8, option == "expand");
+            cout << "Object removed in " << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms, "
+                << "result " << image_removed.cols << " x " << image_removed.rows << endl;
+
+            imwrite("output_removed.png", image_removed);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 8, "protect ") == 0) {
+            // Carve to a smaller size while keeping the pixels of a protect mask image
+            stringstream ss(input.substr(8));
+            string mask_name;
+            int width, height;
+            if (!(ss >> mask_name >> width >> height) || (ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'protect <mask> <width> <height>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+            Mat protect_mask = imread(mask_name + ".png", IMREAD_GRAYSCALE);
+            if (protect_mask.empty() || protect_mask.size() != original_image.size()) {
+                cout << "Could not open a protect mask of " << original_width << " x " << original_height
+                    << " named " << mask_name << ".png" << endl;
+                continue;
+            }
+
+            Mat image_protected = original_image.clone();
+            string report;
+            if (!carveProtected(image_protected, protect_mask, width, height, report)) {
+                cout << "Target size is unreachable without cutting protected pixels: " << report << endl;
+                continue;
+            }
+
+            imwrite("output_protected.png", image_protected);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 4, "roi ") == 0) {
+            // Carve only inside a region of interest, shifting everything else rigidly
+            stringstream ss(input.substr(4));
+            Rect roi;
+            int width, height;
+            if (!(ss >> roi.x >> roi.y >> roi.width >> roi.height >> width >> height) || (ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'roi <x> <y> <roi width> <roi height> <width> <height>'." << endl;
+                continue;
+            }
+            if (roi != (roi & Rect(0, 0, original_width, original_height)) || roi.area() == 0
+                || width <= original_width - roi.width || width > original_width
+                || height <= original_height - roi.height || height > original_height) {
+                cout << "Invalid region. The ROI must lie inside the image and keep at least one of its columns and rows." << endl;
+                continue;
+            }
+
+            int64 start = getTickCount();
+            Mat image_roi = original_image.clone();
+            removeVerticalSeamsDP(image_roi, roi, original_width - width);
+            roi.width -= original_width - width;
+            removeHorizontalSeamsDP(image_roi, roi, original_height - height);
+            cout << "ROI carve in " << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+
+            imwrite("output_roi.png", image_roi);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input == "calibrate") {
+            // Time every strategy on the loaded image and store the fitted cost model
+            cout << "Calibrating the planner cost model..." << endl;
+            cost_model = calibrateCostModel(original_image);
+            if (!cost_model.save(cost_model_path))
+                cout << "Could not write the cost model to " << cost_model_path << endl;
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 5, "plan ") == 0) {
+            // Carve within a time budget with the strategy picked by the planner
+            stringstream ss(input.substr(5));
+            double budget_ms;
+            int width, height;
+            if (!(ss >> budget_ms >> width >> height) || (ss >> ws, !ss.eof()) || budget_ms <= 0) {
+                cout << "Invalid input. Please enter 'plan <budget ms> <width> <height>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            imwrite("output_planned.png", carveWithinBudget(cost_model, original_image, width, height, budget_ms));
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 9, "deadline ") == 0) {
+            // Carve until the deadline and resize the rest
+            stringstream ss(input.substr(9));
+            double deadline_ms;
+            int width, height;
+            if (!(ss >> deadline_ms >> width >> height) || (ss >> ws, !ss.eof()) || deadline_ms < 0) {
+                cout << "Invalid input. Please enter 'deadline <ms> <width> <height>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            int64 start = getTickCount();
+            AnytimeResult anytime = carveWithDeadline(original_image, width, height, deadline_ms);
+            double elapsed_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+            cout << "Deadline " << deadline_ms << " ms: " << anytime.carved_seams << " seams carved, "
+                << anytime.scaled_seams << " scaled, " << elapsed_ms << " ms total" << endl;
+
+            imwrite("output_deadline.png", anytime.image);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 7, "hybrid ") == 0) {
+            // Scale part of the reduction uniformly and carve the rest, with a fixed or automatic split
+            stringstream ss(input.substr(7));
+            int width, height;
+            string split;
+            double scale_fraction = 0, budget_ms = 0, min_preservation = 0;
+            bool valid = (bool)(ss >> width >> height >> split);
+            if (valid && split == "auto")
+                valid = (bool)(ss >> budget_ms >> min_preservation) && budget_ms >= 0;
+            else if (valid) {
+                stringstream fraction_ss(split);
+                valid = (bool)(fraction_ss >> scale_fraction) && (fraction_ss >> ws, fraction_ss.eof())
+                    && scale_fraction >= 0 && scale_fraction <= 1;
+            }
+            if (!valid || (ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'hybrid <width> <height> <fraction>' or "
+                    << "'hybrid <width> <height> auto <budget ms> <min energy preservation>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            if (split == "auto")
+                scale_fraction = chooseScaleFraction(cost_model, original_image, Size(width, height), budget_ms, min_preservation);
+            imwrite("output_hybrid.png", hybridScaleCarve(cost_model, original_image, width, height, scale_fraction));
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 6, "batch ") == 0) {
+            // Carve every image of a directory or manifest to one or more sizes
+            stringstream ss(input.substr(6));
+            string source;
+            vector<int> values;
+            int value;
+            ss >> source;
+            while (ss >> value)
+                values.push_back(value);
+            vector<Size> targets;
+            for (size_t k = 0; k + 1 < values.size(); k += 2)
+                targets.push_back(Size(values[k], values[k + 1]));
+            if (source.empty() || values.empty() || values.size() % 2 != 0 || (ss.clear(), ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'batch <directory or manifest> <width> <height> [<width> <height> ...]'." << endl;
+                continue;
+            }
+            if (any_of(targets.begin(), targets.end(), [](const Size& target) { return target.width <= 0 || target.height <= 0; })) {
+                cout << "Invalid dimensions. Width and height must be positive." << endl;
+                continue;
+            }
+
+            carveBatch(source, targets, "batch_output");
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 6, "slabs ") == 0) {
+            // Carve with slab-parallel approximate seams and compare against global seams,
+            // on the loaded image or on every image of a sample set
+            stringstream ss(input.substr(6));
+            int num_slabs, width, height;
+            string sample_set;
+            if (!(ss >> num_slabs >> width >> height) || num_slabs <= 0 || width <= 0 || height <= 0) {
+                cout << "Invalid input. Please enter 'slabs <slabs> <width> <height> [directory or manifest]'." << endl;
+                continue;
+            }
+            ss >> sample_set;
+            if (ss >> ws, !ss.eof()) {
+                cout << "Invalid input. Please enter 'slabs <slabs> <width> <height> [directory or manifest]'." << endl;
+                continue;
+            }
+
+            if (sample_set.empty()) {
+                if (width > original_width || height > original_height) {
+                    cout << "Invalid dimensions. Width and height must be within "
+                        << original_width << " x " << original_height << "." << endl;
+                    continue;
+                }
+                Mat image_slabs;
+                try {
+                    printSlabComparison(filename, compareSlabCarve(original_image, width, height, num_slabs, &image_slabs));
+                }
+                catch (const Exception& e) {
+                    cout << filename << ": slab carving failed: " << e.err << endl;
+                    continue;
+                }
+                imwrite("output_slabs.png", image_slabs);
+                continue;
+            }
+
+            // Sizes are clamped to each image of the sample set
+            double total_speedup = 0, total_loss = 0;
+            int num_compared = 0;
+            for (const filesystem::path& image_path : listBatchImages(sample_set)) {
+                Mat image = imread(image_path.string(), IMREAD_UNCHANGED);
+                if (image.empty())
+                    continue;
+                SlabComparison comparison;
+                try {
+                    comparison = compareSlabCarve(image, min(width, image.cols), min(height, image.rows), num_slabs);
+                }
+                catch (const Exception& e) {
+                    cout << image_path.string() << ": slab carving failed: " << e.err << endl;
+                    continue;
+                }
+                printSlabComparison(image_path.string(), comparison);
+                total_speedup += comparison.speedup();
+                total_loss += comparison.qualityLoss();
+                num_compared++;
+            }
+            if (num_compared > 0) {
+                cout << num_compared << " images: mean speedup " << total_speedup / num_compared << "x, mean quality loss "
+                    << total_loss / num_compared << "%" << endl;
+            }
+            else
+                cout << "No images found in " << sample_set << endl;
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input == "outofcore" || input.compare(0, 10, "outofcore ") == 0) {
+            // Self-check of the out-of-core engine on synthetic images
+            stringstream ss(input.substr(9));
+            int width = 8192, height = 4096, memory_mb = 8, num_seams = 4;
+            if (!(ss >> ws).eof() && (!(ss >> width >> height >> memory_mb >> num_seams) || (ss >> ws, !ss.eof())
+                || width <= num_seams || height <= 0 || memory_mb <= 0 || num_seams < 0)) {
+                cout << "Invalid input. Please enter 'outofcore [<width> <height> <memory MB> <seams>]'." << endl;
+                continue;
+            }
+
+            cout << "Checking the out-of-core engine..." << endl;
+            bool passed = checkOutOfCore(width, height, (size_t)memory_mb << 20, num_seams);
+            cout << (passed ? "Out-of-core check passed" : "Out-of-core check FAILED") << endl;
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 9, "progress ") == 0) {
+            // Carve on a worker thread while this thread polls the progress, optionally cancelling after a while
+            stringstream ss(input.substr(9));
+            int width, height;
+            double cancel_after_ms = -1;
+            if (!(ss >> width >> height) || (!(ss >> ws).eof() && !(ss >> cancel_after_ms)) || (ss >> ws, !ss.eof())) {
+                cout << "Invalid input. Please enter 'progress <width> <height> [cancel after ms]'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            CarveProgress progress;
+            Mat image_progress = original_image.clone();
+            int64 start = getTickCount(), end = 0;
+            thread worker([&]() {
+                carveWithProgress(image_progress, width, height, progress);
+                end = getTickCount();
+            });
+
+            int64 cancel_time = 0;
+            while (progress.phase.load(memory_order_acquire) < CARVE_PHASE_DONE) {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                double elapsed_ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+                cout << "\r" << CARVE_PHASE_NAMES[progress.phase.load(memory_order_relaxed)] << ": "
+                    << progress.seams_done.load(memory_order_relaxed) << " / " << progress.seams_total.load(memory_order_relaxed)
+                    << " seams, " << cvRound(elapsed_ms) << " ms   " << flush;
+                if (cancel_after_ms >= 0 && elapsed_ms >= cancel_after_ms && !cancel_time) {
+                    progress.cancel.cancel();
+                    cancel_time = getTickCount();
+                }
+            }
+            worker.join();
+            cout << endl;
+
+            if (progress.phase == CARVE_PHASE_CANCELLED) {
+                // Hand the buffers the job left in the allocator cache back to the system
+                image_progress.release();
+                allocator.releaseCached();
+                cout << "Cancelled after " << progress.seams_done << " of " << progress.seams_total << " seams, stopped "
+                    << (end - cancel_time) * 1000.0 / getTickFrequency() << " ms after the request" << endl;
+            }
+            else
+                imwrite("output_progress.png", image_progress);
+            continue; // Go back to the beginning of the loop for new input
+        }
+        else if (input.compare(0, 5, "beam ") == 0) {
+            // Carve with a beam search of the requested width
+            stringstream ss(input.substr(5));
+            int beam_width, width, height;
+            if (!(ss >> beam_width >> width >> height) || (ss >> ws, !ss.eof()) || beam_width <= 0) {
+                cout << "Invalid input. Please enter 'beam <beam width> <width> <height>'." << endl;
+                continue;
+            }
+            if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
+                cout << "Invalid dimensions. Width and height must be positive and within "
+                    << original_width << " x " << original_height << "." << endl;
+                continue;
+            }
+
+            int64 start = getTickCount();
+            Mat image_beam = original_image.clone();
+            for (int i = 0; i < original_width - width; i++) {
+                removeVerticalSeamBeam(image_beam, beam_width);
+            }
+            removeHorizontalSeams(image_beam, original_height - height, removeVerticalSeamBeam, beam_width);
+            cout << "Beam search carve in " << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+
+            imwrite("output_beam.png", image_beam);
             continue; // Go back to the beginning of the loop for new input
         }
 
-        // Use a stringstream to parse the input for width and height
+        // Use a stringstream to parse the input for one or more width and height pairs
         stringstream ss(input);
-        int width, height;
-        if (!(ss >> width >> height) || (ss >> ws, !ss.eof())) {
+        vector<int> values;
+        int value;
+        while (ss >> value) {
+            values.push_back(value);
+        }
+        vector<Size> targets;
+        for (size_t k = 0; k + 1 < values.size(); k += 2) {
+            targets.push_back(Size(values[k], values[k + 1]));
+        }
+        if (values.empty() || values.size() % 2 != 0 || !ss.eof()) {
             // If parsing fails or there are extra characters, prompt again
-            cout << "Invalid input. Please enter exactly two integer values for width and height." << endl;
+            cout << "Invalid input. Please enter pairs of integer values for width and height." << endl;
             continue; // Prompt again if input is invalid
         }
 
-        // Check that the new dimensions are within valid bounds
-        if (width <= 0 || width > original_width || height <= 0 || height > original_height) {
-            cout << "Invalid dimensions. Width and height must be positive and within "
-                << original_width << " x " << original_height << "." << endl;
+        // Check that the new dimensions are valid; sizes above the original are reached by seam insertion
+        bool valid_targets = true;
+        vector<Size> reduced_targets;
+        for (const Size& target : targets) {
+            if (target.width <= 0 || target.height <= 0)
+                valid_targets = false;
+            reduced_targets.push_back(Size(min(target.width, original_width), min(target.height, original_height)));
+        }
+        if (!valid_targets) {
+            cout << "Invalid dimensions. Width and height must be positive." << endl;
             continue; // Prompt again if dimensions are out of bounds
         }
 
         // Set the validated new dimensions
-        new_width = width;
-        new_height = height;
+        new_width = targets[0].width;
+        new_height = targets[0].height;
 
         // Calculate the number of seams to remove for width and height
         int num_vertical_seams = original_width - new_width;
         int num_horizontal_seams = original_height - new_height;
 
-        // Ensure that the new dimensions are smaller than or equal to the original
-        if (num_vertical_seams < 0 || num_horizontal_seams < 0) {
-            cout << "New dimensions must be smaller than or equal to the original dimensions." << endl;
-            continue;
-        }
+        // Dynamic programming results are looked up when a seam index map, sidecar or retargeting maps exist
+        bool precomputed_dp = !seam_index_map.empty() || seam_sidecar || !retargeting_maps.levels.empty();
 
-        // Clone the original image to create separate images for DP and Greedy methods
-        Mat image_dp = original_image.clone();
-        Mat image_greedy = original_image.clone();
+        if (targets.size() > 1) {
+            // Batch mode: the vertical phase of each algorithm is shared across all targets
+            int64 start = getTickCount();
+            vector<Mat> images_greedy = carveToSizes(original_image, reduced_targets, removeVerticalSeamGreedy);
+            vector<Mat> images_dp;
+            if (!precomputed_dp)
+                images_dp = carveToSizes(original_image, reduced_targets, removeVerticalSeamDP);
 
-        // Remove vertical seams using Dynamic Programming
-        for (int i = 0; i < num_vertical_seams; i++) {
-            removeVerticalSeamDP(image_dp);
-        }
+            // Save every result under its size
+            for (size_t k = 0; k < targets.size(); k++) {
+                stringstream ss_filename_dp, ss_filename_greedy;
+                ss_filename_dp << "output_dp_" << targets[k].width << "x" << targets[k].height << ".png";
+                ss_filename_greedy << "output_greedy_" << targets[k].width << "x" << targets[k].height << ".png";
 
-        // Remove horizontal seams using Dynamic Programming
-        for (int i = 0; i < num_horizontal_seams; i++) {
-            removeHorizontalSeamDP(image_dp);
-        }
+                Mat image_dp = precomputed_dp
+                    ? retargetDP(original_image, reduced_targets[k], seam_index_map, seam_sidecar.get(), retargeting_maps)
+                    : images_dp[k];
 
-        // Remove vertical seams using the Greedy algorithm
-        for (int i = 0; i < num_vertical_seams; i++) {
-            removeVerticalSeamGreedy(image_greedy);
-        }
+                // Enlarge with seam insertion where the target exceeds the original
+                insertVerticalSeams(image_dp, targets[k].width - original_width);
+                insertHorizontalSeams(image_dp, targets[k].height - original_height);
+                insertVerticalSeams(images_greedy[k], targets[k].width - original_width);
+                insertHorizontalSeams(images_greedy[k], targets[k].height - original_height);
 
-        // Remove horizontal seams using the Greedy algorithm
-        for (int i = 0; i < num_horizontal_seams; i++) {
-            removeHorizontalSeamGreedy(image_greedy);
+                imwrite(ss_filename_dp.str(), image_dp);
+                imwrite(ss_filename_greedy.str(), images_greedy[k]);
+            }
+            cout << targets.size() << " sizes carved in "
+                << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+            continue; // Go back to the beginning of the loop for new input
         }
 
-        // Prepare filenames for saving the output images
-        stringstream ss_filename_dp, ss_filename_greedy;
-        ss_filename_dp << "output_dp_" << new_width << "x" << new_height << ".png";
-        ss_filename_greedy << "output_greedy_" << new_width << "x" << new_height << ".png";
+        // Enlarge with seam insertion where the target exceeds the original
+        // All results use the batched dynamic programming seam discovery for insertion
+        auto enlarge = [new_width, new_height, original_width, original_height](Mat& image) {
+            insertVerticalSeams(image, new_width - original_width);
+            insertHorizontalSeams(image, new_height - original_height);
+        };
 
-        // Save the results with fixed filenames
-        imwrite("output_dp.png", image_dp);
-        imwrite("output_greedy.png", image_greedy);
+        // Carve with every algorithm concurrently
+        // The Dynamic Programming result uses the precomputed maps when there are any and the shared energy map otherwise
+        Size reduced_target = reduced_targets[0];
+        vector<CarveVariant> variants = {
+            { "Dynamic Programming Result", "output_dp.png", [&](const Mat& image, const Mat& initial_energy) {
+                Mat result;
+                if (precomputed_dp) {
+                    result = retargetDP(image, reduced_target, seam_index_map, seam_sidecar.get(), retargeting_maps);
+                } else {
+                    result = image.clone();
+                    carveVerticalSeams(result, num_vertical_seams, initial_energy, [](const Mat& energy_map) {
+                        return findVerticalSeamDP(energy_map);
+                    });
+                    removeHorizontalSeams(result, num_horizontal_seams, removeVerticalSeamDP);
+                }
+                enlarge(result);
+                return result;
+            } },
+            { "Greedy Algorithm Result", "output_greedy.png", [&](const Mat& image, const Mat& initial_energy) {
+                Mat result = image.clone();
+                carveVerticalSeams(result, num_vertical_seams, initial_energy, [](const Mat& energy_map) {
+                    return findVerticalSeamGreedy(energy_map);
+                });
+                removeHorizontalSeams(result, num_horizontal_seams, removeVerticalSeamGreedy);
+                enlarge(result);
+                return result;
+            } },
+            { "Multi-start Greedy Result", "output_multi_greedy.png", [&](const Mat& image, const Mat& initial_energy) {
+                Mat result = image.clone();
+                carveVerticalSeams(result, num_vertical_seams, initial_energy, findVerticalSeamMultiGreedy);
+                removeHorizontalSeams(result, num_horizontal_seams, removeVerticalSeamMultiGreedy);
+                enlarge(result);
+                return result;
+            } },
+        };
+        runCarveVariants(original_image, variants);
 
         // Display the original and processed images in separate windows
         namedWindow("Original Image", WINDOW_AUTOSIZE);
         imshow("Original Image", original_image);
 
-        namedWindow("Dynamic Programming Result", WINDOW_AUTOSIZE);
-        imshow("Dynamic Programming Result", image_dp);
-
-        namedWindow("Greedy Algorithm Result", WINDOW_AUTOSIZE);
-        imshow("Greedy Algorithm Result", image_greedy);
+        for (const CarveVariant& variant : variants) {
+            namedWindow(variant.name, WINDOW_AUTOSIZE);
+            imshow(variant.name, variant.result);
+        }
 
         // Wait for a key press to proceed
         waitKey(0);
@@ -0,0 +1,25 @@
+// Carving kernels built for AVX2 (see SeamCarveKernels.simd.hpp)
+// MSVC builds this file with /arch:AVX2 (set on the file in the project)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2,fma,f16c,popcnt")
+#endif
+
+#define CV_CPU_DISPATCH_MODE AVX2
+#define CV_SSE 1
+#define CV_SSE2 1
+#define CV_SSE3 1
+#define CV_SSSE3 1
+#define CV_SSE4_1 1
+#define CV_SSE4_2 1
+#define CV_POPCNT 1
+#define CV_AVX 1
+#define CV_FP16 1
+#define CV_AVX2 1
+#define CV_FMA3 1
+#include <immintrin.h>
+
+#include "SeamCarveKernels.simd.hpp"
+
+#endif
@@ -0,0 +1,31 @@
+// Carving kernels built for AVX-512 as on Skylake-X (see SeamCarveKernels.simd.hpp)
+// MSVC builds this file with /arch:AVX512 (set on the file in the project)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#if defined(__GNUC__) && !defined(__AVX512BW__)
+#pragma GCC target("avx512f,avx512cd,avx512bw,avx512dq,avx512vl,avx2,fma,f16c,popcnt")
+#endif
+
+#define CV_CPU_DISPATCH_MODE AVX512_SKX
+#define CV_SSE 1
+#define CV_SSE2 1
+#define CV_SSE3 1
+#define CV_SSSE3 1
+#define CV_SSE4_1 1
+#define CV_SSE4_2 1
+#define CV_POPCNT 1
+#define CV_AVX 1
+#define CV_FP16 1
+#define CV_AVX2 1
+#define CV_FMA3 1
+#define CV_AVX_512F 1
+#define CV_AVX_512CD 1
+#define CV_AVX_512BW 1
+#define CV_AVX_512DQ 1
+#define CV_AVX_512VL 1
+#define CV_AVX512_SKX 1
+#include <immintrin.h>
+
+#include "SeamCarveKernels.simd.hpp"
+
+#endif
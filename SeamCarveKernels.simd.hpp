@@ -0,0 +1,174 @@
+// Carving kernels compiled once per instruction set and picked at startup by carveKernels() in SeamCarve.cpp
+// Laid out like the OpenCV *.simd.hpp sources: SeamCarve.cpp builds this file in the cpu_baseline namespace,
+// and every SeamCarveKernels.<isa>.cpp wrapper builds it again in opt_<ISA> after setting CV_CPU_DISPATCH_MODE
+// and the matching compiler options. With CV_CPU_OPTIMIZATION_DECLARATIONS_ONLY only the declarations are
+// emitted, which is how SeamCarveKernels.simd_declarations.hpp declares every tier.
+// No include guard: the file is included once per tier.
+
+#include <opencv2/core.hpp>
+
+#undef SEAMCARVE_CPU_NAMESPACE_BEGIN
+#undef SEAMCARVE_CPU_NAMESPACE_END
+#ifdef CV_CPU_DISPATCH_MODE
+#define SEAMCARVE_CPU_NAMESPACE_BEGIN namespace __CV_CAT(opt_, CV_CPU_DISPATCH_MODE) {
+#else
+#define SEAMCARVE_CPU_NAMESPACE_BEGIN namespace cpu_baseline {
+#endif
+#define SEAMCARVE_CPU_NAMESPACE_END }
+
+namespace seamcarve {
+SEAMCARVE_CPU_NAMESPACE_BEGIN
+
+// Function to compute one row of the Sobel energy of an 8-bit gray image
+// above and below are the neighbouring rows, already reflected at the top and bottom of the image.
+// Gives the same values as computeEnergyMap: the mean of |dx| and |dy| saturated to 8 bits, rounded to even.
+void energyRow(const uchar* above, const uchar* row, const uchar* below, uchar* energy, int cols);
+
+// Function to fill the interior of a row of the cumulative energy map
+// row[j] = energy[j] + min(above[j - 1], above[j], above[j + 1]) for j in [0, n); above[-1] and above[n] must exist
+void cumulativeRow(const int* above, const uchar* energy, int* row, int n);
+
+// Function to fill the interior of a row of the cumulative energy map with protected pixels
+// Like cumulativeRow, but pixels whose mask is set cost protected_energy and every sum saturates at INT_MAX
+void cumulativeRowMasked(const int* above, const uchar* energy, const uchar* mask, int protected_energy, int* row, int n);
+
+// Function to copy the pixels of a row whose mark is zero, returning how many were copied
+int compactRow(const uchar* src, const uchar* mark, uchar* dst, int cols, size_t pixel_size);
+
+#ifndef CV_CPU_OPTIMIZATION_DECLARATIONS_ONLY
+
+} // cpu namespace
+} // namespace seamcarve
+
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace seamcarve {
+SEAMCARVE_CPU_NAMESPACE_BEGIN
+
+using namespace cv;
+using std::abs;
+using std::min;
+
+// Energy of one pixel given the columns to its left and right, for the row ends
+static inline uchar energyPixel(const uchar* above, const uchar* row, const uchar* below, int left, int j, int right) {
+    int dx = (above[right] - above[left]) + 2 * (row[right] - row[left]) + (below[right] - below[left]);
+    int dy = (below[left] + 2 * below[j] + below[right]) - (above[left] + 2 * above[j] + above[right]);
+    int sum = min(abs(dx), 255) + min(abs(dy), 255);
+    return (uchar)((sum + ((sum >> 1) & 1)) >> 1);
+}
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+// Energy of a vector of pixels from their widened neighbourhoods
+static inline v_uint16 energyHalf(const v_int16& al, const v_int16& ac, const v_int16& ar,
+                                  const v_int16& rl, const v_int16& rr,
+                                  const v_int16& bl, const v_int16& bc, const v_int16& br) {
+    v_int16 dx = v_add(v_add(v_sub(ar, al), v_sub(br, bl)), v_shl<1>(v_sub(rr, rl)));
+    v_int16 dy = v_sub(v_add(v_add(bl, br), v_shl<1>(bc)), v_add(v_add(al, ar), v_shl<1>(ac)));
+    v_uint16 max_gradient = vx_setall_u16(255);
+    v_uint16 sum = v_add(v_min(v_abs(dx), max_gradient), v_min(v_abs(dy), max_gradient));
+
+    // Halve, rounding ties to even like addWeighted
+    return v_shr<1>(v_add(sum, v_and(v_shr<1>(sum), vx_setall_u16(1))));
+}
+
+// Function to load a vector of 8-bit pixels widened to two vectors of 16-bit lanes
+static inline void loadWide(const uchar* ptr, v_int16& low, v_int16& high) {
+    v_uint16 a, b;
+    v_expand(vx_load(ptr), a, b);
+    low = v_reinterpret_as_s16(a);
+    high = v_reinterpret_as_s16(b);
+}
+#endif
+
+void energyRow(const uchar* above, const uchar* row, const uchar* below, uchar* energy, int cols) {
+    // Columns are reflected at the row ends like the Sobel border
+    if (cols == 1) {
+        energy[0] = energyPixel(above, row, below, 0, 0, 0);
+        return;
+    }
+    energy[0] = energyPixel(above, row, below, 1, 0, 1);
+
+    int j = 1;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = VTraits<v_uint8>::vlanes();
+    for (; j + lanes < cols; j += lanes) {
+        v_int16 al0, al1, ac0, ac1, ar0, ar1, rl0, rl1, rr0, rr1, bl0, bl1, bc0, bc1, br0, br1;
+        loadWide(above + j - 1, al0, al1);
+        loadWide(above + j, ac0, ac1);
+        loadWide(above + j + 1, ar0, ar1);
+        loadWide(row + j - 1, rl0, rl1);
+        loadWide(row + j + 1, rr0, rr1);
+        loadWide(below + j - 1, bl0, bl1);
+        loadWide(below + j, bc0, bc1);
+        loadWide(below + j + 1, br0, br1);
+        v_store(energy + j, v_pack(energyHalf(al0, ac0, ar0, rl0, rr0, bl0, bc0, br0),
+                                   energyHalf(al1, ac1, ar1, rl1, rr1, bl1, bc1, br1)));
+    }
+#endif
+    for (; j < cols - 1; j++)
+        energy[j] = energyPixel(above, row, below, j - 1, j, j + 1);
+    energy[cols - 1] = energyPixel(above, row, below, cols - 2, cols - 1, cols - 2);
+}
+
+void cumulativeRow(const int* above, const uchar* energy, int* row, int n) {
+    int j = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = VTraits<v_int32>::vlanes();
+    for (; j + lanes <= n; j += lanes) {
+        v_int32 min_energy = v_min(v_min(vx_load(above + j - 1), vx_load(above + j)), vx_load(above + j + 1));
+        v_store(row + j, v_add(v_reinterpret_as_s32(vx_load_expand_q(energy + j)), min_energy));
+    }
+#endif
+    for (; j < n; j++)
+        row[j] = energy[j] + min(min(above[j - 1], above[j]), above[j + 1]);
+}
+
+void cumulativeRowMasked(const int* above, const uchar* energy, const uchar* mask, int protected_energy, int* row, int n) {
+    int j = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = VTraits<v_int32>::vlanes();
+    const v_int32 protected_vec = vx_setall_s32(protected_energy), max_vec = vx_setall_s32(INT_MAX);
+    for (; j + lanes <= n; j += lanes) {
+        v_int32 min_energy = v_min(v_min(vx_load(above + j - 1), vx_load(above + j)), vx_load(above + j + 1));
+        v_int32 is_protected = v_reinterpret_as_s32(v_ne(vx_load_expand_q(mask + j), vx_setzero_u32()));
+        v_int32 pixel_energy = v_select(is_protected, protected_vec, v_reinterpret_as_s32(vx_load_expand_q(energy + j)));
+
+        // Lanes past INT_MAX wrap in the add and are replaced by the saturated value
+        v_int32 saturated = v_gt(min_energy, v_sub(max_vec, pixel_energy));
+        v_store(row + j, v_select(saturated, max_vec, v_add(pixel_energy, min_energy)));
+    }
+#endif
+    for (; j < n; j++) {
+        int min_energy = min(min(above[j - 1], above[j]), above[j + 1]);
+        int pixel_energy = mask[j] ? protected_energy : energy[j];
+        row[j] = min_energy > INT_MAX - pixel_energy ? INT_MAX : pixel_energy + min_energy;
+    }
+}
+
+int compactRow(const uchar* src, const uchar* mark, uchar* dst, int cols, size_t pixel_size) {
+    // Copy runs of unmarked pixels at once; a run ends at each marked pixel
+    int copied = 0, run_start = 0, j = 0;
+    while (j < cols) {
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        // Skip whole vectors of unmarked pixels
+        const int lanes = VTraits<v_uint8>::vlanes();
+        while (j + lanes <= cols && !v_check_any(v_ne(vx_load(mark + j), vx_setzero_u8())))
+            j += lanes;
+        if (j >= cols)
+            break;
+#endif
+        if (mark[j]) {
+            memcpy(dst + copied * pixel_size, src + run_start * pixel_size, (j - run_start) * pixel_size);
+            copied += j - run_start;
+            run_start = j + 1;
+        }
+        j++;
+    }
+    memcpy(dst + copied * pixel_size, src + run_start * pixel_size, (cols - run_start) * pixel_size);
+    return copied + cols - run_start;
+}
+
+#endif // CV_CPU_OPTIMIZATION_DECLARATIONS_ONLY
+
+SEAMCARVE_CPU_NAMESPACE_END
+} // namespace seamcarve
@@ -0,0 +1,23 @@
+// Declarations of the carving kernels of every dispatched instruction set (see SeamCarveKernels.simd.hpp)
+// The tiers are only built for x86; other targets run the baseline kernels.
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SEAMCARVE_DISPATCH_X86 1
+
+#define CV_CPU_OPTIMIZATION_DECLARATIONS_ONLY
+
+#define CV_CPU_DISPATCH_MODE SSE4_2
+#include "SeamCarveKernels.simd.hpp"
+#undef CV_CPU_DISPATCH_MODE
+
+#define CV_CPU_DISPATCH_MODE AVX2
+#include "SeamCarveKernels.simd.hpp"
+#undef CV_CPU_DISPATCH_MODE
+
+#define CV_CPU_DISPATCH_MODE AVX512_SKX
+#include "SeamCarveKernels.simd.hpp"
+#undef CV_CPU_DISPATCH_MODE
+
+#undef CV_CPU_OPTIMIZATION_DECLARATIONS_ONLY
+#endif
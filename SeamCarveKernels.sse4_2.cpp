@@ -0,0 +1,20 @@
+// Carving kernels built for SSE4.2 (see SeamCarveKernels.simd.hpp)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#if defined(__GNUC__) && !defined(__SSE4_2__)
+#pragma GCC target("sse4.2,popcnt")
+#endif
+
+#define CV_CPU_DISPATCH_MODE SSE4_2
+#define CV_SSE 1
+#define CV_SSE2 1
+#define CV_SSE3 1
+#define CV_SSSE3 1
+#define CV_SSE4_1 1
+#define CV_SSE4_2 1
+#define CV_POPCNT 1
+#include <nmmintrin.h>
+
+#include "SeamCarveKernels.simd.hpp"
+
+#endif